@@ -0,0 +1,42 @@
+/**
+ * @file MetricsController.h
+ * @author Frederik Pedersen
+ * @brief Controller exposing the server's metrics to Prometheus.
+ * @version 0.1
+ * @date 2024-05-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef METRICS_CONTROLLER_H
+#define METRICS_CONTROLLER_H
+
+#include <Metrics.h>
+#include <Router.h>
+
+class MetricsController
+{
+public:
+    MetricsController(Router *router)
+    {
+        router->addRoute("GET", "/metrics", [](const HttpRequest &, HttpResponse &res) { handleMetrics(res); });
+    }
+
+private:
+    /**
+     * @brief Render every registered metric in the Prometheus text format
+     *
+     * @param res The response
+     */
+    static void handleMetrics(HttpResponse &res)
+    {
+        auto text = MetricsRegistry::getInstance().render();
+        res.result(http::status::ok);
+        res.set(http::field::content_type, "text/plain; version=0.0.4; charset=utf-8");
+        res.body().assign(text.data(), text.size());
+        res.prepare_payload();
+    }
+};
+
+#endif // METRICS_CONTROLLER_H
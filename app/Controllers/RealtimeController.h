@@ -0,0 +1,105 @@
+/**
+ * @file RealtimeController.h
+ * @author Frederik Pedersen
+ * @brief Controller for commands sent over the websocket connection
+ * @version 0.1
+ * @date 2024-04-29
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef REALTIME_CONTROLLER_H
+#define REALTIME_CONTROLLER_H
+
+#include <WebSocketRouter.h>
+#include <chrono>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+
+using json = nlohmann::json;
+
+class RealtimeController
+{
+public:
+    RealtimeController(WebSocketRouter *router)
+    {
+        router->addCommand("ping", [this](const json &data, const WebSocketContext &ctx) { handlePing(data, ctx); });
+        router->addCommand("subscribe",
+                           [this](const json &data, const WebSocketContext &ctx) { handleSubscribe(data, ctx); });
+        router->addCommand("unsubscribe",
+                           [this](const json &data, const WebSocketContext &ctx) { handleUnsubscribe(data, ctx); });
+    }
+
+private:
+    /**
+     * @brief Answer a ping with the server time, so clients can check the connection and measure latency
+     *
+     * @param data Unused
+     * @param ctx The command context
+     */
+    void handlePing(const json &, const WebSocketContext &ctx)
+    {
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+        ctx.reply({{"time", now}});
+    }
+
+    /**
+     * @brief Subscribe the session to the topic named in data, e.g. {"topic": "portfolio/42"}
+     *
+     * @param data The command data
+     * @param ctx The command context
+     */
+    void handleSubscribe(const json &data, const WebSocketContext &ctx)
+    {
+        auto topic = topicFrom(data);
+        if (!topic)
+            return ctx.error("Invalid topic");
+
+        bool changed = ctx.subscribe(*topic);
+        ctx.reply({{"topic", *topic}, {"subscribed", true}, {"changed", changed}});
+    }
+
+    /**
+     * @brief Unsubscribe the session from the topic named in data
+     *
+     * @param data The command data
+     * @param ctx The command context
+     */
+    void handleUnsubscribe(const json &data, const WebSocketContext &ctx)
+    {
+        auto topic = topicFrom(data);
+        if (!topic)
+            return ctx.error("Invalid topic");
+
+        bool changed = ctx.unsubscribe(*topic);
+        ctx.reply({{"topic", *topic}, {"subscribed", false}, {"changed", changed}});
+    }
+
+    /**
+     * @brief Read the topic name from command data
+     *
+     * @return The topic, or std::nullopt if it is missing, empty or longer than MaxTopicLength
+     */
+    static std::optional<std::string> topicFrom(const json &data)
+    {
+        if (!data.is_object())
+            return std::nullopt;
+
+        auto topic = data.find("topic");
+        if (topic == data.end() || !topic->is_string())
+            return std::nullopt;
+
+        auto const &name = topic->get_ref<const std::string &>();
+        if (name.empty() || name.size() > MaxTopicLength)
+            return std::nullopt;
+        return name;
+    }
+
+    static constexpr std::size_t MaxTopicLength = 128;
+};
+
+#endif // REALTIME_CONTROLLER_H
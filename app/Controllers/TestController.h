@@ -14,6 +14,7 @@
 
 #include "AuthenticationMiddleware.h"
 #include "LogService.h"
+#include <HttpStream.h>
 #include <Router.h>
 #include <fmt/format.h>
 #include <functional>
@@ -31,6 +32,11 @@ public:
                          "/test",
                          AuthenticationMiddleware::WithAuthentication(
                              [this](const HttpRequest &req, HttpResponse &res) { this->handleHelloWorld(req, res); }));
+        router->addRoute("POST",
+                         "/test/echo",
+                         AuthenticationMiddleware::WithAuthentication(
+                             StreamHandler([](const HttpStream &stream) { handleEcho(stream); })),
+                         RouteOptions{64 * 1024 * 1024});
     }
 
 private:
@@ -60,6 +66,42 @@ private:
             LOG(LogService::LogLevel::ERROR, e.what());
         }
     }
+
+    /**
+     * @brief Send the request body back as a chunked response, one chunk at a time
+     *
+     * @param stream The request
+     */
+    static void handleEcho(const HttpStream &stream)
+    {
+        stream.writeHeader(http::status::ok,
+                           "application/octet-stream",
+                           [stream](beast::error_code ec)
+                           {
+                               if (!ec)
+                                   echoNextChunk(stream);
+                           });
+    }
+
+    static void echoNextChunk(const HttpStream &stream)
+    {
+        stream.read(
+            [stream](beast::error_code ec, std::string_view chunk)
+            {
+                if (ec)
+                    return;
+
+                if (chunk.empty())
+                    return stream.finish();
+
+                stream.write(std::string(chunk),
+                             [stream](beast::error_code writeError)
+                             {
+                                 if (!writeError)
+                                     echoNextChunk(stream);
+                             });
+            });
+    }
 };
 
 #endif // TEST_CONTROLLER_H
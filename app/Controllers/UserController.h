@@ -25,46 +25,40 @@ class UserController
 public:
     UserController(std::shared_ptr<UserService> userService, Router *router) : userService(std::move(userService))
     {
-        router->addRoute("POST", "/user/create", [this](const HttpRequest &req, HttpResponse &res) {
-            this->handleCreateUser(req, res);
-        });
-        router->addRoute("POST", "/user/login", [this](const HttpRequest &req, HttpResponse &res) {
-            this->handleUserLogin(req, res);
-        });
+        router->addRoute(
+            "POST",
+            "/user/create",
+            [this](const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done) {
+                this->handleCreateUser(req, res, ctx, std::move(done));
+            },
+            CredentialsRouteOptions);
+        router->addRoute(
+            "POST",
+            "/user/login",
+            [this](const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done) {
+                this->handleUserLogin(req, res, ctx, std::move(done));
+            },
+            CredentialsRouteOptions);
     }
 
 private:
+    /// Both routes take a small JSON object with a username and password
+    static constexpr RouteOptions CredentialsRouteOptions{1024};
+
     /**
      * @brief Handle the request for creating a new user
      *
      * @param request The request
      * @param response The response
+     * @param ctx The request context
+     * @param done Called once the response is written
      */
-    void handleCreateUser(const HttpRequest &req, HttpResponse &res)
+    void handleCreateUser(const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done)
     {
-        try
-        {
-            auto createUserResult = userService->CreateUser(req.body());
-            auto jsonResponse = createUserResult.toJson();
-            if (createUserResult.isSuccess)
-            {
-                res.result(http::status::ok);
-                res.set(http::field::content_type, "application/json");
-                res.body() = jsonResponse.dump();
-                res.prepare_payload();
-            }
-            else
-            {
-                res.result(http::status::bad_request);
-                res.set(http::field::content_type, "application/json");
-                res.body() = jsonResponse.dump();
-                res.prepare_payload();
-            }
-        }
-        catch (const std::exception &e)
-        {
-            LOG(LogService::LogLevel::ERROR, e.what());
-        }
+        userService->CreateUser(req.body(), ctx.executor(), [&res, done](const ResponseDto<UserDto> &result) {
+            writeResponse(res, result);
+            done();
+        });
     }
 
     /**
@@ -72,27 +66,44 @@ private:
      *
      * @param request
      * @param response
+     * @param ctx The request context
+     * @param done Called once the response is written
      */
-    void handleUserLogin(const HttpRequest &req, HttpResponse &res)
+    void handleUserLogin(const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done)
+    {
+        userService->UserLogin(req.body(), ctx.executor(), [&res, done](const ResponseDto<UserDto> &result) {
+            writeResponse(res, result);
+            done();
+        });
+    }
+
+    /**
+     * @brief Fill in the response for a user operation result
+     *
+     * @param res The response
+     * @param result The result from the user service
+     */
+    static void writeResponse(HttpResponse &res, const ResponseDto<UserDto> &result)
     {
         try
         {
-            auto getUserResult = userService->UserLogin(req.body());
-            auto jsonResponse = getUserResult.toJson();
-            if (getUserResult.isSuccess)
+            auto jsonResponse = result.toJson();
+            if (result.isSuccess)
             {
                 res.result(http::status::ok);
-                res.set(http::field::content_type, "application/json");
-                res.body() = jsonResponse.dump();
-                res.prepare_payload();
+            }
+            else if (result.isUnavailable)
+            {
+                res.result(http::status::service_unavailable);
+                res.set(http::field::retry_after, "1");
             }
             else
             {
                 res.result(http::status::bad_request);
-                res.set(http::field::content_type, "application/json");
-                res.body() = jsonResponse.dump();
-                res.prepare_payload();
             }
+            res.set(http::field::content_type, "application/json");
+            res.body() = jsonResponse.dump();
+            res.prepare_payload();
         }
         catch (const std::exception &e)
         {
@@ -24,6 +24,8 @@ public:
     bool isSuccess;
     std::optional<T> result;
     std::optional<std::string> errorMessage;
+    /// The request was refused because the server is overloaded and may be retried later
+    bool isUnavailable = false;
 
     static ResponseDto Success(const T &data)
     {
@@ -35,6 +37,11 @@ public:
         return {false, std::nullopt, message};
     }
 
+    static ResponseDto Unavailable(const std::string &message)
+    {
+        return {false, std::nullopt, message, true};
+    }
+
     /**
      * @brief Convert the response to a json object
      *
@@ -1,47 +0,0 @@
-// This file was generated by ODB, object-relational mapping (ORM)
-// compiler for C++.
-//
-
-namespace odb
-{
-// User
-//
-
-inline access::object_traits<::User>::id_type access::object_traits<::User>::id(const object_type &o)
-{
-    return o.id;
-}
-
-inline void access::object_traits<::User>::callback(database &db, object_type &x, callback_event e)
-{
-    ODB_POTENTIALLY_UNUSED(db);
-    ODB_POTENTIALLY_UNUSED(x);
-    ODB_POTENTIALLY_UNUSED(e);
-}
-
-inline void access::object_traits<::User>::callback(database &db, const object_type &x, callback_event e)
-{
-    ODB_POTENTIALLY_UNUSED(db);
-    ODB_POTENTIALLY_UNUSED(x);
-    ODB_POTENTIALLY_UNUSED(e);
-}
-} // namespace odb
-
-namespace odb
-{
-// User
-//
-
-inline void access::object_traits_impl<::User, id_pgsql>::erase(database &db, const object_type &obj)
-{
-    callback(db, obj, callback_event::pre_erase);
-    erase(db, id(obj));
-    callback(db, obj, callback_event::post_erase);
-}
-
-inline void access::object_traits_impl<::User, id_pgsql>::load_(statements_type &sts, object_type &obj, bool)
-{
-    ODB_POTENTIALLY_UNUSED(sts);
-    ODB_POTENTIALLY_UNUSED(obj);
-}
-} // namespace odb
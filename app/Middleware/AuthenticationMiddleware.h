@@ -5,8 +5,10 @@
 #ifndef CCFOLIO_AUTHENTICATIONMIDDLEWARE_H
 #define CCFOLIO_AUTHENTICATIONMIDDLEWARE_H
 
+#include <HttpStream.h>
 #include <JWTHelper.h>
 #include <Router.h>
+#include <Tracing.h>
 
 class AuthenticationMiddleware
 {
@@ -20,17 +22,80 @@ public:
     static auto WithAuthentication(Handler func) -> Handler
     {
         return [func](const HttpRequest &req, HttpResponse &res) {
-            if (!JWTHelper::ValidateToken(req, res))
+            if (!Authenticate(req, res))
+                return;
+            func(req, res);
+        };
+    }
+
+    /**
+     * @brief Middleware for verifying jwt tokens in front of an asynchronous handler
+     *
+     * @param func The function to call if the token is valid
+     * @return A handler that calls the given function if the token is valid, and completes at once otherwise
+     */
+    static auto WithAuthentication(AsyncHandler func) -> AsyncHandler
+    {
+        return [func](const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done) {
+            if (!Authenticate(req, res))
             {
-                res.result(http::status::unauthorized);
-                res.set(http::field::content_type, "application/json");
-                res.body() = "Invalid or missing token";
-                res.prepare_payload();
+                done();
                 return;
             }
-            func(req, res);
+            func(req, res, ctx, std::move(done));
+        };
+    }
+
+    /**
+     * @brief Middleware for verifying jwt tokens in front of a streaming handler
+     *
+     * @param func The function to call if the token is valid
+     * @return A handler that calls the given function if the token is valid, and responds 401 without reading the
+     * body otherwise
+     */
+    static auto WithAuthentication(StreamHandler func) -> StreamHandler
+    {
+        return [func](const HttpStream &stream) {
+            if (!Authenticate(stream))
+                return;
+            func(stream);
         };
     }
+
+private:
+    /**
+     * @brief Validate the request's token, traced as its own span
+     *
+     * @return true if the token is valid, otherwise the response is set to 401 Unauthorized
+     */
+    static bool Authenticate(const HttpRequest &req, HttpResponse &res)
+    {
+        ScopedSpan span("AuthenticationMiddleware.ValidateToken");
+        if (JWTHelper::ValidateToken(req, res))
+            return true;
+
+        res.result(http::status::unauthorized);
+        res.set(http::field::content_type, "application/json");
+        res.body() = "Invalid or missing token";
+        res.prepare_payload();
+        return false;
+    }
+
+    /**
+     * @brief Validate the stream's token, traced as its own span
+     *
+     * @return true if the token is valid, otherwise the stream is answered with 401 Unauthorized and ended
+     */
+    static bool Authenticate(const HttpStream &stream)
+    {
+        ScopedSpan span("AuthenticationMiddleware.ValidateToken");
+        if (JWTHelper::VerifyRequest(stream.request()))
+            return true;
+
+        // The body is left unread, so the connection is closed after the response
+        stream.respond(http::status::unauthorized, "application/json", "Invalid or missing token");
+        return false;
+    }
 };
 
 
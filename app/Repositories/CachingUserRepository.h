@@ -0,0 +1,114 @@
+/**
+ * @file CachingUserRepository.h
+ * @author Frederik Pedersen
+ * @brief Read-through cache in front of a user repository
+ * @version 0.1
+ * @date 2024-04-23
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef CACHING_USER_REPOSITORY_H
+#define CACHING_USER_REPOSITORY_H
+
+#include "IUserRepository.h"
+#include "LogService.h"
+#include "OperationResult.h"
+#include <ShardedLruCache.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fmt/format.h>
+#include <memory>
+#include <optional>
+#include <string>
+
+/**
+ * @brief Decorator that caches user lookups by username.
+ *
+ * Found users are cached for ttl and unknown usernames for negativeTtl, so repeated logins and signups with a
+ * taken or free name skip the database. Failed lookups are never cached. createUser drops the cached entry for
+ * the username whatever the outcome, and lookups that overlap a write do not cache a negative result. The cache
+ * is not locked across the database call, so negativeTtl also bounds how long a stale miss can survive.
+ */
+class CachingUserRepository : public IUserRepository
+{
+public:
+    using Cache = ShardedLruCache<std::string, std::optional<User>>;
+    using CacheStats = Cache::Stats;
+
+    CachingUserRepository(std::shared_ptr<IUserRepository> repository,
+                          std::size_t capacity,
+                          std::chrono::seconds ttl,
+                          std::chrono::seconds negativeTtl)
+        : repository(std::move(repository)), cache(capacity), ttl(ttl), negativeTtl(negativeTtl)
+    {
+    }
+
+    /**
+     * @brief Get a user by username, from the cache if possible
+     *
+     * @param username Username of the user
+     * @return OperationResult<std::optional<User>>, holding std::nullopt if no such user exists
+     */
+    OperationResult<std::optional<User>> getUserByUsername(const std::string &username) override
+    {
+        if (auto cached = cache.get(username))
+            return OperationResult<std::optional<User>>::SuccessResult(std::move(*cached));
+
+        auto generation = writeGeneration.load(std::memory_order_acquire);
+        auto result = repository->getUserByUsername(username);
+        if (!result.IsSuccess())
+            return result;
+
+        if (result.GetResult().has_value())
+            cache.put(username, result.GetResult(), ttl);
+        else if (generation == writeGeneration.load(std::memory_order_acquire))
+            cache.put(username, std::nullopt, negativeTtl);
+
+        return result;
+    }
+
+    /**
+     * @brief Create a new user. A username that is cached as taken is refused without asking the database.
+     *
+     * @param user User to create
+     * @return OperationResult<User>
+     */
+    OperationResult<User> createUser(User user) override
+    {
+        auto username = user.getUsername();
+        if (auto cached = cache.get(username); cached && cached->has_value())
+        {
+            return OperationResult<User>::FailureResult(
+                fmt::format("User with username: {0} already exist.", username));
+        }
+
+        // Bumped on both sides of the write so that lookups overlapping it do not cache a negative result
+        writeGeneration.fetch_add(1, std::memory_order_acq_rel);
+        auto result = repository->createUser(std::move(user));
+        writeGeneration.fetch_add(1, std::memory_order_acq_rel);
+        cache.erase(username);
+        return result;
+    }
+
+    CacheStats cacheStats() const
+    {
+        return cache.stats();
+    }
+
+    std::size_t cacheCapacity() const noexcept
+    {
+        return cache.capacity();
+    }
+
+private:
+    std::shared_ptr<IUserRepository> repository;
+    Cache cache;
+    std::chrono::seconds ttl;
+    std::chrono::seconds negativeTtl;
+    std::atomic<std::uint64_t> writeGeneration{0};
+};
+
+#endif // CACHING_USER_REPOSITORY_H
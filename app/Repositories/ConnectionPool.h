@@ -0,0 +1,91 @@
+/**
+ * @file ConnectionPool.h
+ * @author Frederik Pedersen
+ * @brief PostgreSQL connection pool that records checkout counts and wait times
+ * @version 0.1
+ * @date 2024-04-22
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <odb/pgsql/connection-factory.hxx>
+#include <odb/pgsql/connection.hxx>
+
+/**
+ * @brief ODB connection pool with checkout metrics.
+ *
+ * Connections beyond minConnections are closed when they are returned, so minConnections is the number of idle
+ * connections kept open. When maxConnections are in use, callers wait for one to be returned. Since every
+ * connection keeps its own prepared statements, reusing pooled connections also reuses their query plans.
+ */
+class ConnectionPool : public odb::pgsql::connection_pool_factory
+{
+public:
+    struct Stats
+    {
+        std::uint64_t checkouts;
+        std::uint64_t connectionsOpened;
+        std::uint64_t totalWaitMicroseconds;
+        std::uint64_t maxWaitMicroseconds;
+    };
+
+    /**
+     * @param maxConnections Connections that may be open at once, 0 for no limit
+     * @param minConnections Idle connections kept open between checkouts
+     * @param ping Check that a pooled connection is still alive before handing it out
+     */
+    ConnectionPool(std::size_t maxConnections, std::size_t minConnections, bool ping)
+        : odb::pgsql::connection_pool_factory(maxConnections, minConnections, ping)
+    {
+    }
+
+    /**
+     * @brief Check out a connection, waiting for one to be returned if the pool is exhausted
+     */
+    odb::pgsql::connection_ptr connect() override
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto connection = odb::pgsql::connection_pool_factory::connect();
+        auto waited = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+        checkouts.fetch_add(1, std::memory_order_relaxed);
+        totalWaitMicroseconds.fetch_add(waited, std::memory_order_relaxed);
+        auto longest = maxWaitMicroseconds.load(std::memory_order_relaxed);
+        while (waited > longest && !maxWaitMicroseconds.compare_exchange_weak(longest, waited))
+        {
+        }
+        return connection;
+    }
+
+    Stats stats() const noexcept
+    {
+        return {checkouts.load(std::memory_order_relaxed),
+                connectionsOpened.load(std::memory_order_relaxed),
+                totalWaitMicroseconds.load(std::memory_order_relaxed),
+                maxWaitMicroseconds.load(std::memory_order_relaxed)};
+    }
+
+protected:
+    pooled_connection_ptr create() override
+    {
+        connectionsOpened.fetch_add(1, std::memory_order_relaxed);
+        return odb::pgsql::connection_pool_factory::create();
+    }
+
+private:
+    std::atomic<std::uint64_t> checkouts{0};
+    std::atomic<std::uint64_t> connectionsOpened{0};
+    std::atomic<std::uint64_t> totalWaitMicroseconds{0};
+    std::atomic<std::uint64_t> maxWaitMicroseconds{0};
+};
+
+#endif // CONNECTION_POOL_H
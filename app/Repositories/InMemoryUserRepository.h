@@ -0,0 +1,74 @@
+/**
+ * @file InMemoryUserRepository.h
+ * @author Frederik Pedersen
+ * @brief User repository kept in process memory, for running the server without a database
+ * @version 0.1
+ * @date 2024-05-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef IN_MEMORY_USER_REPOSITORY_H
+#define IN_MEMORY_USER_REPOSITORY_H
+
+#include "IUserRepository.h"
+#include "OperationResult.h"
+#include "Tracing.h"
+#include <fmt/format.h>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Stores users in a hash map instead of the database.
+ *
+ * Meant for load tests and local development: the server answers the same way it does with PostgreSQL behind it,
+ * but without the database round trips, so what is measured is the server itself. Users are lost on exit.
+ */
+class InMemoryUserRepository : public IUserRepository
+{
+public:
+    /**
+     * @brief Get a user by username
+     *
+     * @param username Username of the user
+     * @return OperationResult<std::optional<User>>, holding std::nullopt if no such user exists
+     */
+    OperationResult<std::optional<User>> getUserByUsername(const std::string &username) override
+    {
+        ScopedSpan span("InMemoryUserRepository.getUserByUsername");
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = users.find(username);
+        if (it == users.end())
+            return OperationResult<std::optional<User>>::SuccessResult(std::nullopt);
+        return OperationResult<std::optional<User>>::SuccessResult(it->second);
+    }
+
+    /**
+     * @brief Create a new user
+     *
+     * @param user User to create
+     * @return OperationResult<User>, failed if the username is taken
+     */
+    OperationResult<User> createUser(User user) override
+    {
+        ScopedSpan span("InMemoryUserRepository.createUser");
+        auto username = user.getUsername();
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (!users.try_emplace(username, user).second)
+        {
+            return OperationResult<User>::FailureResult(
+                fmt::format("User with username: {0} already exist.", username));
+        }
+        return OperationResult<User>::SuccessResult(std::move(user));
+    }
+
+private:
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, User> users;
+};
+
+#endif // IN_MEMORY_USER_REPOSITORY_H
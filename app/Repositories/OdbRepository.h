@@ -17,6 +17,7 @@
 #include "IRepository.h"
 #include "LogService.h"
 #include "OperationResult.h"
+#include "Tracing.h"
 #include "User-odb.hxx"
 #include <memory>
 #include <odb/database.hxx>
@@ -43,6 +44,7 @@ public:
      */
     OperationResult<bool> Create(T entity) override
     {
+        ScopedSpan span("OdbRepository.Create");
         try
         {
             odb::transaction t(db->begin());
@@ -52,11 +54,13 @@ public:
         }
         catch (const odb::connection_lost &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
@@ -70,6 +74,7 @@ public:
      */
     OperationResult<T> Read(IdType id) const override
     {
+        ScopedSpan span("OdbRepository.Read");
         try
         {
             odb::transaction t(db->begin());
@@ -79,11 +84,13 @@ public:
         }
         catch (const odb::connection_lost &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<T>::FailureResult("Something happened, please try again later.");
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<T>::FailureResult("Something happened, please try again later.");
         }
@@ -97,6 +104,7 @@ public:
      */
     OperationResult<bool> Update(const T &entity) override
     {
+        ScopedSpan span("OdbRepository.Update");
         try
         {
             odb::transaction t(db->begin());
@@ -106,11 +114,13 @@ public:
         }
         catch (const odb::connection_lost &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
@@ -124,6 +134,7 @@ public:
      */
     OperationResult<bool> Delete(IdType id) override
     {
+        ScopedSpan span("OdbRepository.Delete");
         try
         {
             odb::transaction t(db->begin());
@@ -133,11 +144,13 @@ public:
         }
         catch (const odb::connection_lost &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<bool>::FailureResult("Something happened, please try again later.");
         }
@@ -150,6 +163,7 @@ public:
      */
     OperationResult<std::vector<T>> ReadAll() const override
     {
+        ScopedSpan span("OdbRepository.ReadAll");
         try
         {
             odb::transaction t(db->begin());
@@ -164,11 +178,13 @@ public:
         }
         catch (const odb::connection_lost &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<std::vector<T>>::FailureResult("Something happened, please try again later.");
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<std::vector<T>>::FailureResult("Something happened, please try again later.");
         }
@@ -15,11 +15,14 @@
 #include "IUserRepository.h"
 #include "OdbRepository.h"
 #include "OperationResult.h"
+#include "Tracing.h"
 #include "odb/transaction.hxx"
 #include <argon2.h>
 #include <cstring>
 #include <fmt/format.h>
 #include <iostream>
+#include <memory>
+#include <odb/prepared-query.hxx>
 #include <optional>
 #include <random>
 #include <sstream>
@@ -28,6 +31,8 @@
 class UserRepository : public IUserRepository
 {
 private:
+    static constexpr const char *UserByUsernameQuery = "user-by-username";
+
     std::shared_ptr<OdbRepository<User>> dbConnector;
 
 public:
@@ -46,8 +51,10 @@ public:
         try
         {
             auto userExist = getUserByUsername(user.getUsername());
+            if (!userExist.IsSuccess())
+                return OperationResult<User>::FailureResult(userExist.GetErrorMessage());
 
-            if (userExist.IsSuccess())
+            if (userExist.GetResult().has_value())
             {
                 return OperationResult<User>::FailureResult(
                     fmt::format("User with username: {0} already exist.", user.getUsername()));
@@ -73,16 +80,34 @@ public:
      * @brief Get a user by username
      *
      * @param username Username of the user
-     * @return OperationResult<std::optional<User>>
+     * @return OperationResult<std::optional<User>>, holding std::nullopt if no such user exists
      */
     OperationResult<std::optional<User>> getUserByUsername(const std::string &username) override
     {
+        ScopedSpan span("UserRepository.getUserByUsername");
         try
         {
-            odb::core::transaction t(dbConnector->database()->begin());
             typedef odb::query<User> Query;
+            typedef odb::prepared_query<User> PreparedQuery;
             typedef odb::result<User> Result;
-            Result r = dbConnector->database()->query<User>(Query::username == username);
+
+            odb::core::transaction t(dbConnector->database()->begin());
+            auto &connection = t.connection();
+
+            // The statement is prepared once per pooled connection and found again by name on later calls.
+            // Its parameter is bound by reference to a string owned by the connection's query cache.
+            std::string *usernameParam = nullptr;
+            PreparedQuery pq(connection.lookup_query<User>(UserByUsernameQuery, usernameParam));
+            if (!pq)
+            {
+                auto param = std::make_unique<std::string>();
+                usernameParam = param.get();
+                pq = connection.prepare_query<User>(UserByUsernameQuery, Query::username == Query::_ref(*param));
+                connection.cache_query(pq, std::move(param));
+            }
+
+            *usernameParam = username;
+            Result r(pq.execute());
 
             for (auto &user : r)
             {
@@ -90,11 +115,12 @@ public:
                 return OperationResult<std::optional<User>>::SuccessResult(user);
             }
 
-            return OperationResult<std::optional<User>>::FailureResult(
-                fmt::format("Failed to find user with username: {0}", username));
+            t.commit();
+            return OperationResult<std::optional<User>>::SuccessResult(std::nullopt);
         }
         catch (const std::exception &e)
         {
+            span.span().setError();
             LOG(LogService::LogLevel::ERROR, e.what());
             return OperationResult<std::optional<User>>::FailureResult("Something happened, please try again later");
         }
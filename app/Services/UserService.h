@@ -21,9 +21,13 @@
 #include "Utility.h"
 #include "config.hpp"
 #include <JWTHelper.h>
+#include <PasswordHashExecutor.h>
 #include <PasswordHelper.h>
+#include <Tracing.h>
 #include <argon2.h>
+#include <exception>
 #include <fmt/format.h>
+#include <functional>
 #include <jwt-cpp/jwt.h>
 #include <memory>
 #include <nlohmann/json.hpp>
@@ -36,103 +40,191 @@ using json = nlohmann::json;
 class UserService
 {
 public:
-    UserService(std::shared_ptr<IUserRepository> userRepository) : userRepository(std::move(userRepository))
+    UserService(std::shared_ptr<IUserRepository> userRepository, std::shared_ptr<PasswordHashExecutor> hashExecutor)
+        : userRepository(std::move(userRepository)), hashExecutor(std::move(hashExecutor))
     {
     }
 
+    /// Receives the outcome of an asynchronous operation, on the executor passed with the request
+    using Callback = std::function<void(const ResponseDto<UserDto> &)>;
+
     /**
-     * @brief Create a new user
+     * @brief Create a new user. The password is hashed and the user is stored on the hashing pool, so the calling
+     * thread is never blocked by Argon2 or by the database.
      *
      * @param request JSON payload with user data
-     * @return ResponseDto<UserDto>
+     * @param executor Executor the callback is called on
+     * @param callback Called exactly once with the result
      */
-    ResponseDto<UserDto> CreateUser(const std::string &request)
+    void CreateUser(const std::string &request, const net::any_io_executor &executor, Callback callback)
     {
+        ScopedSpan span("UserService.CreateUser");
         try
         {
             auto jsonPayload = json::parse(request);
             std::string username = jsonPayload["username"];
             std::string password = jsonPayload["password"];
 
-            auto [hashedPassword, salt] = PasswordHelper::HashPasswordWithArgon2(password);
-            std::string saltStr = Utility::toHexString(salt);
-
-            User user{username, hashedPassword, saltStr};
-            auto creationResult = userRepository->createUser(user);
-
-            if (creationResult.IsSuccess())
+            // The hash and the insert run on the pool, and continue the trace from the context they carry
+            bool queued = hashExecutor->post(
+                executor,
+                [this, username = std::move(username), password = std::move(password), trace = span.span().context()] {
+                    TraceScope scope(trace);
+                    HashedPassword hash;
+                    {
+                        ScopedSpan hashing("PasswordHelper.HashPasswordWithArgon2");
+                        hash = PasswordHelper::HashPasswordWithArgon2(password);
+                    }
+                    return storeUser(username, hash.first, hash.second);
+                },
+                [callback](std::exception_ptr error, ResponseDto<UserDto> response) {
+                    callback(complete(error, std::move(response)));
+                });
+
+            if (!queued)
             {
-                UserDto userDto{username};
-                userDto.token = JWTHelper::CreateJWTToken(userDto.username);
-                return ResponseDto<UserDto>::Success(userDto);
-            }
-            else
-            {
-                LOG(LogService::LogLevel::INFO, creationResult.GetErrorMessage());
-                return ResponseDto<UserDto>::Failure(creationResult.GetErrorMessage());
+                LOG(LogService::LogLevel::WARN, "Password hashing queue is full");
+                callback(ResponseDto<UserDto>::Unavailable("Server is busy, please try again later"));
             }
         }
         catch (const json::exception &e)
         {
             LOG(LogService::LogLevel::ERROR, e.what());
-            return ResponseDto<UserDto>::Failure("Invalid JSON format");
+            callback(ResponseDto<UserDto>::Failure("Invalid JSON format"));
         }
         catch (const std::exception &e)
         {
             LOG(LogService::LogLevel::ERROR, e.what());
-            return ResponseDto<UserDto>::Failure("Something happened, please try again later");
+            callback(ResponseDto<UserDto>::Failure("Something happened, please try again later"));
         }
     }
 
     /**
-     * @brief Get a user by username
+     * @brief Log a user in. The user is looked up and the password verified on the hashing pool.
      *
-     * @param username
-     * @return ResponseDto<UserDto>
+     * @param request JSON payload with username and password
+     * @param executor Executor the callback is called on
+     * @param callback Called exactly once with the result
      */
-    ResponseDto<UserDto> UserLogin(const std::string &request)
+    void UserLogin(const std::string &request, const net::any_io_executor &executor, Callback callback)
     {
+        ScopedSpan span("UserService.UserLogin");
         try
         {
             auto jsonPayload = json::parse(request);
-            const std::string username = jsonPayload["username"];
-            const std::string password = jsonPayload["password"];
-
-            auto userResult = userRepository->getUserByUsername(username);
-            if (!userResult.IsSuccess() || !userResult.GetResult().has_value())
-            {
-                LOG(LogService::LogLevel::INFO, userResult.GetErrorMessage());
-                return ResponseDto<UserDto>::Failure(userResult.GetErrorMessage());
-            }
-
-            const auto &user = userResult.GetResult().value();
-            bool isLoginSuccess = PasswordHelper::VerifyUserPassword(user.getPasswordHash(), user.getSalt(), password);
+            std::string username = jsonPayload["username"];
+            std::string password = jsonPayload["password"];
 
-            if (!isLoginSuccess)
+            bool queued = hashExecutor->post(
+                executor,
+                [this, username = std::move(username), password = std::move(password), trace = span.span().context()] {
+                    TraceScope scope(trace);
+                    return verifyLogin(username, password);
+                },
+                [callback](std::exception_ptr error, ResponseDto<UserDto> response) {
+                    callback(complete(error, std::move(response)));
+                });
+
+            if (!queued)
             {
-                LOG(LogService::LogLevel::INFO,
-                    fmt::format("Wrong username or password for user with username: {}", user.getUsername()));
-                return ResponseDto<UserDto>::Failure("Wrong username or password!");
+                LOG(LogService::LogLevel::WARN, "Password hashing queue is full");
+                callback(ResponseDto<UserDto>::Unavailable("Server is busy, please try again later"));
             }
-
-            UserDto userDto{userResult.GetResult()->getUsername()};
-            userDto.token = JWTHelper::CreateJWTToken(userDto.username);
-            return ResponseDto<UserDto>::Success(userDto);
         }
         catch (const json::exception &e)
         {
             LOG(LogService::LogLevel::ERROR, e.what());
-            return ResponseDto<UserDto>::Failure("Invalid JSON format");
+            callback(ResponseDto<UserDto>::Failure("Invalid JSON format"));
         }
         catch (const std::exception &e)
         {
             LOG(LogService::LogLevel::ERROR, e.what());
-            return ResponseDto<UserDto>::Failure("Something happened, please try again later");
+            callback(ResponseDto<UserDto>::Failure("Something happened, please try again later"));
         }
     }
 
 private:
+    using HashedPassword = std::pair<std::string, std::vector<uint8_t>>;
+
+    /**
+     * @brief Second half of CreateUser, run on the hashing pool once the password has been hashed
+     */
+    ResponseDto<UserDto> storeUser(const std::string &username,
+                                   const std::string &hashedPassword,
+                                   const std::vector<uint8_t> &salt)
+    {
+        ScopedSpan span("UserService.storeUser");
+        User user{username, hashedPassword, Utility::toHexString(salt)};
+        auto creationResult = userRepository->createUser(user);
+        if (!creationResult.IsSuccess())
+        {
+            LOG(LogService::LogLevel::INFO, creationResult.GetErrorMessage());
+            return ResponseDto<UserDto>::Failure(creationResult.GetErrorMessage());
+        }
+
+        UserDto userDto{username};
+        userDto.token = JWTHelper::CreateJWTToken(userDto.username);
+        return ResponseDto<UserDto>::Success(userDto);
+    }
+
+    /**
+     * @brief Body of UserLogin, run on the hashing pool
+     */
+    ResponseDto<UserDto> verifyLogin(const std::string &username, const std::string &password)
+    {
+        ScopedSpan span("UserService.verifyLogin");
+        auto userResult = userRepository->getUserByUsername(username);
+        if (!userResult.IsSuccess())
+        {
+            LOG(LogService::LogLevel::INFO, userResult.GetErrorMessage());
+            return ResponseDto<UserDto>::Failure(userResult.GetErrorMessage());
+        }
+
+        if (!userResult.GetResult().has_value())
+        {
+            auto message = fmt::format("Failed to find user with username: {0}", username);
+            LOG(LogService::LogLevel::INFO, message);
+            return ResponseDto<UserDto>::Failure(message);
+        }
+
+        const auto &user = userResult.GetResult().value();
+        bool isLoginSuccess;
+        {
+            ScopedSpan verifying("PasswordHelper.VerifyUserPassword");
+            isLoginSuccess = PasswordHelper::VerifyUserPassword(user.getPasswordHash(), user.getSalt(), password);
+        }
+        if (!isLoginSuccess)
+        {
+            LOGF(LogService::LogLevel::INFO, "Wrong username or password for user with username: {}", username);
+            return ResponseDto<UserDto>::Failure("Wrong username or password!");
+        }
+
+        UserDto userDto{user.getUsername()};
+        userDto.token = JWTHelper::CreateJWTToken(userDto.username);
+        return ResponseDto<UserDto>::Success(userDto);
+    }
+
+    /**
+     * @brief Turn an exception thrown on the hashing pool into a failure, run back on the caller's executor
+     */
+    static ResponseDto<UserDto> complete(std::exception_ptr error, ResponseDto<UserDto> response)
+    {
+        if (!error)
+            return response;
+
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception &e)
+        {
+            LOG(LogService::LogLevel::ERROR, e.what());
+        }
+        return ResponseDto<UserDto>::Failure("Something happened, please try again later");
+    }
+
     std::shared_ptr<IUserRepository> userRepository;
+    std::shared_ptr<PasswordHashExecutor> hashExecutor;
 };
 
 
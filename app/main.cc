@@ -1,64 +1,461 @@
+#include <CachingUserRepository.h>
+#include <ConnectionPool.h>
+#include <HttpSession.h>
+#include <InMemoryUserRepository.h>
+#include <JWTHelper.h>
 #include <Listener.h>
+#include <LogService.h>
+#include <Metrics.h>
+#include <MetricsController.h>
 #include <OdbRepository.h>
+#include <PasswordHashExecutor.h>
+#include <RealtimeController.h>
+#include <SendQueue.h>
+#include <ServerConfiguration.h>
 #include <SharedState.h>
 #include <TestController.h>
+#include <Tracing.h>
 #include <UserController.h>
 #include <UserRepository.h>
 #include <UserService.h>
+#include <WebSocketRouter.h>
 #include <boost/asio/signal_set.hpp>
 #include <boost/smart_ptr.hpp>
 #include <config.hpp>
+#include <fmt/format.h>
 #include <iostream>
+#include <limits>
 #include <odb/database.hxx>
 #include <odb/mysql/database.hxx>
 #include <odb/schema-catalog.hxx>
 #include <odb/transaction.hxx>
 #include <vector>
 
-int main()
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+/**
+ * @brief Pin the calling thread to a single CPU. Failures are logged and otherwise ignored.
+ *
+ * @param cpu Index of the CPU, wrapped around the number of available CPUs
+ */
+static void pinCurrentThread(unsigned cpu)
+{
+#ifdef __linux__
+    auto cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    if (int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+        LOGF(LogService::LogLevel::WARN, "Failed to pin thread to CPU {0}: error {1}", cpu % cpus, rc);
+#else
+    (void)cpu;
+#endif
+}
+
+/**
+ * @brief Expose statistics the components already keep as metrics, read whenever /metrics is scraped.
+ * The callbacks hold plain pointers, the metrics must not be rendered once these objects are gone. The pool and
+ * the user cache are null when they are not used.
+ */
+static void registerMetrics(ConnectionPool *pool,
+                            CachingUserRepository *userCache,
+                            PasswordHashExecutor *hashExecutor,
+                            SharedState *state)
 {
-    // Create the database
-    std::shared_ptr<odb::pgsql::database> db(new odb::pgsql::database(std::string(pg_user),
-                                                                      std::string(pg_password),
-                                                                      std::string(pg_database),
-                                                                      std::string(pg_host),
-                                                                      5432));
+    auto &registry = MetricsRegistry::getInstance();
+    auto counter = [&registry](std::string_view name, std::string_view help, std::function<double()> read)
+    { registry.callback(name, help, MetricType::Counter, {}, std::move(read)); };
+    auto gauge = [&registry](std::string_view name, std::string_view help, std::function<double()> read)
+    { registry.callback(name, help, MetricType::Gauge, {}, std::move(read)); };
+
+    if (pool != nullptr)
+    {
+        counter("db_pool_checkouts_total", "Database connections handed out", [pool] {
+            return pool->stats().checkouts;
+        });
+        counter("db_pool_connections_opened_total",
+                "Database connections opened",
+                [pool] { return pool->stats().connectionsOpened; });
+        counter("db_pool_wait_seconds_total",
+                "Time spent waiting for a database connection",
+                [pool] { return pool->stats().totalWaitMicroseconds / 1e6; });
+    }
+
+    if (userCache != nullptr)
+    {
+        counter("user_cache_hits_total", "User lookups answered from the cache", [userCache] {
+            return userCache->cacheStats().hits;
+        });
+        counter("user_cache_misses_total", "User lookups that went to the database", [userCache] {
+            return userCache->cacheStats().misses;
+        });
+        counter("user_cache_evictions_total", "Users evicted from the cache", [userCache] {
+            return userCache->cacheStats().evictions;
+        });
+        gauge("user_cache_entries", "Users in the cache", [userCache] { return userCache->cacheStats().size; });
+    }
+
+    gauge("password_hash_queue_depth", "Password hashes waiting for a thread", [hashExecutor] {
+        return hashExecutor->queueDepth();
+    });
+    counter("password_hash_completed_total", "Password hashes computed", [hashExecutor] {
+        return hashExecutor->completedCount();
+    });
+    counter("password_hash_rejected_total", "Password hashes refused because the queue was full", [hashExecutor] {
+        return hashExecutor->rejectedCount();
+    });
 
-    auto serverAddress = net::ip::make_address(std::string(server_address));
-    auto serverPort = static_cast<unsigned short>(std::atoi(std::string(server_port).c_str()));
-    auto workerThreads = std::max<int>(1, std::atoi("4"));
+    counter("jwt_cache_hits_total", "Token verifications answered from the cache", [] {
+        return JWTHelper::CacheStats().hits;
+    });
+    counter("jwt_cache_misses_total", "Token verifications that checked the signature", [] {
+        return JWTHelper::CacheStats().misses;
+    });
 
-    net::io_context ioContext;
+    if (state->staticFiles().enabled())
+    {
+        counter("static_file_cache_hits_total", "Static file requests answered from the cache", [state] {
+            return state->staticFiles().cacheStats().hits;
+        });
+        counter("static_file_cache_misses_total", "Static file requests that opened the file", [state] {
+            return state->staticFiles().cacheStats().misses;
+        });
+        gauge("static_file_cache_entries", "Static files in the cache", [state] {
+            return state->staticFiles().cacheStats().size;
+        });
+    }
+
+    gauge("websocket_sessions", "Open websocket sessions", [state] { return state->sessionCount(); });
+    gauge("websocket_deflate_sessions", "Open websocket sessions that negotiated permessage-deflate", [state] {
+        return state->deflateSessionCount();
+    });
+    gauge("websocket_deflate_memory_bytes", "Estimated zlib memory of all compressed websocket sessions", [state] {
+        return state->deflateMemoryBytes();
+    });
+    gauge("websocket_topics", "Topics with at least one subscriber", [state] { return state->topicCount(); });
+    counter("websocket_topic_published_total", "Messages published to topics", [state] {
+        return state->topicTotals().published;
+    });
+    counter("websocket_topic_delivered_total", "Topic messages sent to subscribers", [state] {
+        return state->topicTotals().delivered;
+    });
+    // Per topic series only for the busiest topics, so the number of series stays bounded
+    constexpr std::size_t BusiestTopics = 10;
+    registry.collector("websocket_busiest_topic_delivered_total",
+                       "Messages sent to subscribers of the topics that delivered the most",
+                       MetricType::Counter,
+                       [state] {
+                           MetricSamples samples;
+                           for (auto const &topic : state->busiestTopics(BusiestTopics))
+                               samples.push_back({{{"topic", topic.name}}, static_cast<double>(topic.delivered)});
+                           return samples;
+                       });
+    registry.collector("websocket_busiest_topic_subscribers",
+                       "Subscribers of the topics that delivered the most",
+                       MetricType::Gauge,
+                       [state] {
+                           MetricSamples samples;
+                           for (auto const &topic : state->busiestTopics(BusiestTopics))
+                               samples.push_back({{{"topic", topic.name}}, static_cast<double>(topic.subscribers)});
+                           return samples;
+                       });
+    counter("websocket_send_dropped_total", "Websocket messages dropped for slow clients", [] {
+        return SendQueue::globalStats().dropped;
+    });
+    counter("websocket_send_coalesced_total", "Websocket messages replaced by a newer one for slow clients", [] {
+        return SendQueue::globalStats().coalesced;
+    });
+    counter("websocket_slow_consumer_disconnects_total", "Websocket clients disconnected for reading too slowly", [] {
+        return SendQueue::globalStats().disconnects;
+    });
+    gauge("websocket_send_queued_bytes", "Bytes waiting in websocket send queues", [] {
+        return SendQueue::globalStats().queuedBytes;
+    });
+
+    registry.callback("http_shed_connections_total",
+                      "HTTP connections closed for running over a deadline or a size limit",
+                      MetricType::Counter,
+                      {{"reason", "timeout"}},
+                      [] { return HttpSession::shedStats().timeouts; });
+    registry.callback("http_shed_connections_total",
+                      "HTTP connections closed for running over a deadline or a size limit",
+                      MetricType::Counter,
+                      {{"reason", "limit"}},
+                      [] { return HttpSession::shedStats().limits; });
+
+    counter("arena_upstream_allocations_total", "Blocks the request arenas took from the heap", [] {
+        return MonotonicArena::globalStats().upstreamAllocations;
+    });
+    counter("arena_bytes_allocated_total", "Bytes handed out by the request arenas", [] {
+        return MonotonicArena::globalStats().bytesAllocated;
+    });
+
+    counter("log_messages_written_total", "Log messages written", [] {
+        return LogService::getInstance().stats().written;
+    });
+    counter("log_messages_dropped_total", "Log messages dropped because the queue was full", [] {
+        return LogService::getInstance().stats().dropped;
+    });
+    gauge("log_queue_depth", "Log messages waiting to be written", [] {
+        return LogService::getInstance().stats().queueDepth;
+    });
+
+    counter("trace_spans_exported_total", "Spans written to the trace file", [] {
+        return Tracer::getInstance().stats().exported;
+    });
+    counter("trace_spans_dropped_total", "Spans dropped because the exporter fell behind", [] {
+        return Tracer::getInstance().stats().dropped;
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    std::optional<ServerConfiguration> config;
+    try
+    {
+        config = ServerConfiguration::FromCommandLine(argc, argv);
+        if (!config)
+            return EXIT_SUCCESS;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto &logService = LogService::getInstance();
+    if (config->logOverflow == "drop")
+        logService.setOverflowPolicy(LogService::OverflowPolicy::Drop);
+    else if (config->logOverflow == "block")
+        logService.setOverflowPolicy(LogService::OverflowPolicy::Block);
+    else
+        logService.setOverflowPolicy(LogService::OverflowPolicy::CountAndDrop);
+    logService.setFlushInterval(std::chrono::milliseconds(config->logFlushMs));
+    logService.setDeferredFormatting(config->logDeferredFormat);
+
+    if (!config->traceFile.empty())
+    {
+        try
+        {
+            TracingOptions tracing;
+            tracing.file = config->traceFile;
+            tracing.sampleRatio = config->traceSampleRatio;
+            Tracer::getInstance().start(tracing);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto serverAddress = net::ip::make_address(config->address);
+    auto serverPort = config->port;
+    auto workerThreads = config->threads;
 
     // Create the router
     Router httpRouter;
 
     // Create repositories and services
-    auto userRepository = std::make_shared<UserRepository>(std::make_shared<OdbRepository<User>>(db));
-    auto userService = std::make_shared<UserService>(userRepository);
+    ConnectionPool *pool = nullptr;
+    std::shared_ptr<IUserRepository> userRepository;
+    if (config->inMemoryUsers)
+    {
+        LOG(LogService::LogLevel::WARN, "Users are kept in memory and lost when the server stops");
+        userRepository = std::make_shared<InMemoryUserRepository>();
+    }
+    else
+    {
+        // Create the database on top of a pool, so connections and their prepared statements are reused
+        auto connectionPool =
+            std::make_unique<ConnectionPool>(config->dbMaxConnections, config->dbMinConnections, config->dbPing);
+        pool = connectionPool.get();
+        std::shared_ptr<odb::pgsql::database> db(new odb::pgsql::database(std::string(pg_user),
+                                                                          std::string(pg_password),
+                                                                          std::string(pg_database),
+                                                                          std::string(pg_host),
+                                                                          5432,
+                                                                          "",
+                                                                          std::move(connectionPool)));
+        userRepository = std::make_shared<UserRepository>(std::make_shared<OdbRepository<User>>(db));
+    }
+    std::shared_ptr<CachingUserRepository> userCache;
+    if (config->userCacheSize > 0)
+    {
+        userCache = std::make_shared<CachingUserRepository>(userRepository,
+                                                            config->userCacheSize,
+                                                            std::chrono::seconds(config->userCacheTtl),
+                                                            std::chrono::seconds(config->userCacheNegativeTtl));
+        userRepository = userCache;
+    }
+    // Argon2 runs on its own pool, sized so that concurrent hashes stay within the memory budget
+    auto hashThreads = std::min(static_cast<std::size_t>(config->hashThreads),
+                                PasswordHashExecutor::ThreadsForMemoryBudget(config->hashMemoryMiB * 1024 * 1024));
+    auto hashExecutor = std::make_shared<PasswordHashExecutor>(hashThreads, config->hashQueue);
+    auto userService = std::make_shared<UserService>(userRepository, hashExecutor);
 
     // Create the controllers
     UserController userController(userService, &httpRouter);
     TestController testController(&httpRouter);
+    std::optional<MetricsController> metricsController;
+    if (config->metrics)
+        metricsController.emplace(&httpRouter);
+    try
+    {
+        for (auto const &limit : config->httpRouteBodyLimits)
+            httpRouter.setBodyLimit(limit.method, limit.path, limit.bytes);
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    httpRouter.freeze();
+
+    WebSocketRouter webSocketRouter;
+    RealtimeController realtimeController(&webSocketRouter);
+    webSocketRouter.freeze();
+
+    SendQueueOptions sendQueue;
+    sendQueue.maxMessages = config->wsQueueMessages;
+    sendQueue.highWatermarkBytes = config->wsQueueHighWatermarkKiB * 1024;
+    sendQueue.lowWatermarkBytes = config->wsQueueLowWatermarkKiB * 1024;
+    if (config->wsSlowConsumerPolicy == "coalesce")
+        sendQueue.policy = SlowConsumerPolicy::Coalesce;
+    else if (config->wsSlowConsumerPolicy == "disconnect")
+        sendQueue.policy = SlowConsumerPolicy::Disconnect;
+    DeflateOptions deflate;
+    deflate.enabled = config->wsDeflate;
+    deflate.windowBits = config->wsDeflateWindowBits;
+    deflate.compressionLevel = config->wsDeflateLevel;
+    deflate.minMessageBytes = config->wsDeflateMinSize;
+    deflate.contextTakeover = config->wsDeflateContextTakeover;
+    if (deflate.enabled)
+    {
+        LOGF(LogService::LogLevel::INFO,
+             "Websocket compression uses about {0} KiB per compressed session",
+             deflate.memoryPerSession() / 1024);
+        if (!DeflateOptions::ThresholdSupported && deflate.minMessageBytes > 0)
+            LOG(LogService::LogLevel::WARN,
+                "This version of Beast compresses every websocket message, --ws-deflate-min-size is ignored");
+    }
+    HttpOptions httpOptions;
+    httpOptions.pipelineDepth = config->httpPipelineDepth;
+    httpOptions.headerTimeout = std::chrono::seconds(config->httpHeaderTimeout);
+    httpOptions.bodyTimeout = std::chrono::seconds(config->httpBodyTimeout);
+    httpOptions.idleTimeout = std::chrono::seconds(config->httpIdleTimeout);
+    httpOptions.writeTimeout = std::chrono::seconds(config->httpWriteTimeout);
+    httpOptions.headerLimit = static_cast<std::uint32_t>(
+        std::min<std::size_t>(config->httpHeaderLimit, std::numeric_limits<std::uint32_t>::max()));
+    httpOptions.bodyLimit = config->httpBodyLimit;
+    httpOptions.maxRequestsPerConnection = config->httpMaxRequests;
+    StaticFileOptions staticFiles;
+    staticFiles.enabled = config->staticFiles;
+    staticFiles.cacheEntries = config->staticCacheEntries;
+    staticFiles.smallFileBytes = config->staticSmallFileKiB * 1024;
+    staticFiles.revalidateAfter = std::chrono::seconds(config->staticRevalidate);
+    auto state = boost::make_shared<SharedState>(config->docRoot, sendQueue, deflate, httpOptions, staticFiles);
+    if (config->metrics)
+        registerMetrics(pool, userCache.get(), hashExecutor.get(), state.get());
+    auto endpoint = tcp::endpoint{serverAddress, serverPort};
+
+    // Shared mode runs one io_context on every thread, per-thread mode gives each thread its own
+    auto mode = config->reusePort ? ListenerMode::PerThread : ListenerMode::Shared;
+    auto contextCount = mode == ListenerMode::PerThread ? workerThreads : 1;
 
-    boost::make_shared<Listener>(ioContext,
-                                 tcp::endpoint{serverAddress, serverPort},
-                                 boost::make_shared<SharedState>(std::string(doc_root)),
-                                 httpRouter)
-        ->run();
+    std::vector<std::unique_ptr<net::io_context>> contexts;
+    contexts.reserve(static_cast<std::size_t>(contextCount));
+    for (auto i = 0; i < contextCount; ++i)
+    {
+        contexts.push_back(std::make_unique<net::io_context>(mode == ListenerMode::PerThread ? 1 : workerThreads));
+        boost::make_shared<Listener>(*contexts.back(), endpoint, state, httpRouter, webSocketRouter, mode)->run();
+    }
     std::cout << "Server listening on " << serverAddress << ":" << serverPort << std::endl;
 
-    net::signal_set signals(ioContext, SIGINT, SIGTERM);
-    signals.async_wait([&ioContext](boost::system::error_code const &, int) { ioContext.stop(); });
+    net::signal_set signals(*contexts.front(), SIGINT, SIGTERM);
+    signals.async_wait([&contexts](boost::system::error_code const &, int) {
+        for (auto &context : contexts)
+            context->stop();
+    });
 
+    auto pin = config->pinThreads;
     std::vector<std::thread> v;
-    v.reserve(workerThreads - 1);
+    v.reserve(static_cast<std::size_t>(workerThreads - 1));
     for (auto i = workerThreads - 1; i > 0; --i)
-        v.emplace_back([&ioContext] { ioContext.run(); });
-    ioContext.run();
+    {
+        auto &context = *contexts[static_cast<std::size_t>(i % contextCount)];
+        v.emplace_back([&context, pin, i] {
+            if (pin)
+                pinCurrentThread(static_cast<unsigned>(i));
+            context.run();
+        });
+    }
+
+    if (pin)
+        pinCurrentThread(0);
+    contexts.front()->run();
 
     for (auto &t : v)
         t.join();
 
+    if (pool != nullptr)
+    {
+        auto poolStats = pool->stats();
+        LOGF(LogService::LogLevel::INFO,
+             "Database pool: {0} checkouts, {1} connections opened, {2} us total wait, {3} us longest wait",
+             poolStats.checkouts,
+             poolStats.connectionsOpened,
+             poolStats.totalWaitMicroseconds,
+             poolStats.maxWaitMicroseconds);
+    }
+    if (userCache)
+    {
+        auto cacheStats = userCache->cacheStats();
+        LOGF(LogService::LogLevel::INFO,
+             "User cache: {0}/{1} entries, {2} hits, {3} misses, {4} evictions, {5} expirations",
+             cacheStats.size,
+             userCache->cacheCapacity(),
+             cacheStats.hits,
+             cacheStats.misses,
+             cacheStats.evictions,
+             cacheStats.expirations);
+    }
+
+    if (state->staticFiles().enabled())
+    {
+        auto fileStats = state->staticFiles().cacheStats();
+        LOGF(LogService::LogLevel::INFO,
+             "Static file cache: {0} entries, {1} hits, {2} misses, {3} evictions",
+             fileStats.size,
+             fileStats.hits,
+             fileStats.misses,
+             fileStats.evictions);
+    }
+
+    auto sendStats = SendQueue::globalStats();
+    LOGF(LogService::LogLevel::INFO,
+         "Websocket send queues: {0} messages dropped, {1} coalesced, {2} slow clients disconnected",
+         sendStats.dropped,
+         sendStats.coalesced,
+         sendStats.disconnects);
+
+    auto shedStats = HttpSession::shedStats();
+    LOGF(LogService::LogLevel::INFO,
+         "HTTP connections shed: {0} timed out, {1} over a size limit",
+         shedStats.timeouts,
+         shedStats.limits);
+
+    if (Tracer::getInstance().enabled())
+    {
+        Tracer::getInstance().stop();
+        auto traceStats = Tracer::getInstance().stats();
+        LOGF(LogService::LogLevel::INFO,
+             "Tracing: {0} spans exported, {1} dropped",
+             traceStats.exported,
+             traceStats.dropped);
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,127 @@
+//
+// Created by fred on 5/6/24.
+//
+
+#include <Beast.h>
+#include <Listener.h>
+#include <Net.h>
+#include <SharedState.h>
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+/**
+ * @brief A server with one listener and n websocket clients connected to it over loopback.
+ * The clients count every message they receive, so a broadcast is done once the count has gone up by n.
+ */
+class BroadcastServer
+{
+public:
+    explicit BroadcastServer(std::size_t clients)
+        : serverContext_(2), state_(boost::make_shared<SharedState>(""))
+    {
+        router_.freeze();
+        webSocketRouter_.freeze();
+
+        // Let the kernel pick a free port, then hand it to the listener
+        tcp::acceptor probe(serverContext_, {net::ip::make_address("127.0.0.1"), 0});
+        auto endpoint = probe.local_endpoint();
+        probe.close();
+        boost::make_shared<Listener>(serverContext_, endpoint, state_, router_, webSocketRouter_)->run();
+        for (int i = 0; i < 2; ++i)
+            serverThreads_.emplace_back([this] { serverContext_.run(); });
+
+        for (std::size_t i = 0; i < clients; ++i)
+        {
+            auto &client = clients_.emplace_back(std::make_unique<Client>(clientContext_));
+            client->ws.next_layer().connect(endpoint);
+            client->ws.handshake("127.0.0.1", "/");
+        }
+        while (state_->sessionCount() < clients)
+            std::this_thread::yield();
+
+        for (auto &client : clients_)
+            read(*client);
+        clientThread_ = std::thread([this] { clientContext_.run(); });
+    }
+
+    ~BroadcastServer()
+    {
+        clientContext_.stop();
+        clientThread_.join();
+        serverContext_.stop();
+        for (auto &thread : serverThreads_)
+            thread.join();
+    }
+
+    SharedState &state() noexcept
+    {
+        return *state_;
+    }
+
+    std::uint64_t received() const noexcept
+    {
+        return received_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Client
+    {
+        explicit Client(net::io_context &context) : ws(context)
+        {
+        }
+
+        websocket::stream<tcp::socket> ws;
+        beast::flat_buffer buffer;
+    };
+
+    void read(Client &client)
+    {
+        client.ws.async_read(client.buffer,
+                             [this, &client](beast::error_code ec, std::size_t)
+                             {
+                                 if (ec)
+                                     return;
+                                 client.buffer.clear();
+                                 received_.fetch_add(1, std::memory_order_release);
+                                 read(client);
+                             });
+    }
+
+    net::io_context serverContext_;
+    net::io_context clientContext_;
+    Router router_;
+    WebSocketRouter webSocketRouter_;
+    boost::shared_ptr<SharedState> state_;
+    std::vector<std::thread> serverThreads_;
+    std::vector<std::unique_ptr<Client>> clients_;
+    std::thread clientThread_;
+    std::atomic<std::uint64_t> received_{0};
+};
+} // namespace
+
+/**
+ * @brief One SharedState::send to every connected session, timed until the last client has received it.
+ * WebSocketSession has no seam for a mock, so the sessions are real and the time includes loopback I/O.
+ */
+static void BM_SharedStateSend(benchmark::State &state)
+{
+    auto clients = static_cast<std::size_t>(state.range(0));
+    BroadcastServer server(clients);
+    std::string message(128, 'm');
+
+    auto expected = server.received();
+    for (auto _ : state)
+    {
+        expected += clients;
+        server.state().send(message);
+        while (server.received() < expected)
+            std::this_thread::yield();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SharedStateSend)->RangeMultiplier(4)->Range(4, 256)->UseRealTime();
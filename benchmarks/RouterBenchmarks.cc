@@ -0,0 +1,69 @@
+//
+// Created by fred on 5/6/24.
+//
+
+#include <Router.h>
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <string>
+#include <tuple>
+
+namespace
+{
+/// Register routes like the controllers do, one static prefix and one parameter each
+void addRoutes(Router &router, std::int64_t count)
+{
+    for (std::int64_t i = 0; i < count; ++i)
+    {
+        router.addRoute("GET",
+                        fmt::format("/api/resource{}/{{id}}", i),
+                        [](const HttpRequest &, HttpResponse &res, const RequestContext &ctx)
+                        {
+                            res.result(http::status::ok);
+                            benchmark::DoNotOptimize(ctx.param("id"));
+                        });
+    }
+    router.freeze();
+}
+} // namespace
+
+/**
+ * @brief Route, match and call a handler, with the request and response in an arena that is reset after every
+ * request, as HttpSession does. Matches the route registered last.
+ */
+static void BM_RouterHandleRequest(benchmark::State &state)
+{
+    Router router;
+    addRoutes(router, state.range(0));
+
+    MonotonicArena arena;
+    auto target = fmt::format("/api/resource{}/42", state.range(0) - 1);
+    for (auto _ : state)
+    {
+        RequestAllocator alloc(arena);
+        HttpRequest req(std::piecewise_construct, std::make_tuple(), std::make_tuple(alloc));
+        req.method(http::verb::get);
+        req.target(target);
+        HttpResponse res(std::piecewise_construct, std::make_tuple(alloc), std::make_tuple(alloc));
+        benchmark::DoNotOptimize(router.handleRequest(req, res));
+        arena.reset();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RouterHandleRequest)->RangeMultiplier(8)->Range(8, 512);
+
+/// Match only, without building a request, to separate the route lookup from the cost of the request objects
+static void BM_RouterMatch(benchmark::State &state)
+{
+    Router router;
+    addRoutes(router, state.range(0));
+
+    auto target = fmt::format("/api/resource{}/42", state.range(0) - 1);
+    for (auto _ : state)
+    {
+        RequestContext ctx;
+        benchmark::DoNotOptimize(router.match(http::verb::get, target, ctx));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RouterMatch)->RangeMultiplier(8)->Range(8, 512);
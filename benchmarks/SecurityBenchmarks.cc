@@ -0,0 +1,41 @@
+//
+// Created by fred on 5/6/24.
+//
+
+#include <JWTHelper.h>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+static void BM_JWTCreateToken(benchmark::State &state)
+{
+    std::string username = "benchmark-user";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(JWTHelper::CreateJWTToken(username));
+}
+BENCHMARK(BM_JWTCreateToken);
+
+/// The same token over and over, answered from the verified token cache after the first call
+static void BM_JWTVerifyTokenCached(benchmark::State &state)
+{
+    auto token = JWTHelper::CreateJWTToken("benchmark-user");
+    for (auto _ : state)
+        benchmark::DoNotOptimize(JWTHelper::VerifyToken(token));
+}
+BENCHMARK(BM_JWTVerifyTokenCached);
+
+/// More distinct tokens than the cache holds, so nearly every call checks the signature
+static void BM_JWTVerifyTokenUncached(benchmark::State &state)
+{
+    std::vector<std::string> tokens;
+    for (int i = 0; i < 16384; ++i)
+        tokens.push_back(JWTHelper::CreateJWTToken("benchmark-user-" + std::to_string(i)));
+
+    std::size_t next = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(JWTHelper::VerifyToken(tokens[next]));
+        next = (next + 1) % tokens.size();
+    }
+}
+BENCHMARK(BM_JWTVerifyTokenUncached);
@@ -0,0 +1,94 @@
+//
+// Created by fred on 5/6/24.
+//
+
+#include <LogService.h>
+#include <ResponseDto.h>
+#include <UserDto.h>
+#include <Utility.h>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static void BM_ToHexString(benchmark::State &state)
+{
+    std::vector<uint8_t> bytes(static_cast<std::size_t>(state.range(0)));
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = static_cast<uint8_t>(i * 31);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Utility::toHexString(bytes));
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+// 16 bytes is the size of a password salt
+BENCHMARK(BM_ToHexString)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_FromHexString(benchmark::State &state)
+{
+    std::vector<uint8_t> bytes(static_cast<std::size_t>(state.range(0)));
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = static_cast<uint8_t>(i * 31);
+    auto hex = Utility::toHexString(bytes);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Utility::fromHexString(hex));
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FromHexString)->Arg(16)->Arg(256)->Arg(4096);
+
+/// The body of a successful login response
+static void BM_ResponseDtoDump(benchmark::State &state)
+{
+    UserDto user{"benchmark-user", std::string(180, 't')};
+    auto response = ResponseDto<UserDto>::Success(user);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(response.toJson().dump());
+}
+BENCHMARK(BM_ResponseDtoDump);
+
+/**
+ * @brief Producer side cost of a log call with every thread logging at once.
+ * Arg 0 drops messages while the queue is full, which measures the producers alone. Arg 1 blocks until the
+ * writer frees a slot, which measures how fast the writer keeps up.
+ */
+static void BM_LogServiceLog(benchmark::State &state)
+{
+    auto &log = LogService::getInstance();
+    if (state.thread_index() == 0)
+    {
+        log.setOverflowPolicy(state.range(0) == 0 ? LogService::OverflowPolicy::Drop
+                                                  : LogService::OverflowPolicy::Block);
+    }
+
+    for (auto _ : state)
+        LOG(LogService::LogLevel::INFO, "Benchmark message of a typical length for a request log line");
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0)
+        log.setOverflowPolicy(LogService::OverflowPolicy::CountAndDrop);
+}
+BENCHMARK(BM_LogServiceLog)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+/// The same call with arithmetic arguments, formatted on the writer thread
+static void BM_LogServiceLogDeferred(benchmark::State &state)
+{
+    auto &log = LogService::getInstance();
+    if (state.thread_index() == 0)
+    {
+        log.setOverflowPolicy(LogService::OverflowPolicy::Drop);
+        log.setDeferredFormatting(true);
+    }
+
+    std::int64_t i = 0;
+    for (auto _ : state)
+        LOGF(LogService::LogLevel::INFO, "Handled request {0} in {1} us", ++i, 42.5);
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0)
+    {
+        log.setDeferredFormatting(false);
+        log.setOverflowPolicy(LogService::OverflowPolicy::CountAndDrop);
+    }
+}
+BENCHMARK(BM_LogServiceLogDeferred)->ThreadRange(1, 8)->UseRealTime();
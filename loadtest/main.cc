@@ -0,0 +1,644 @@
+//
+// Created by fred on 5/7/24.
+//
+
+#include <Beast.h>
+#include <Net.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+/// A request that takes longer than this counts as an error and its connection is replaced
+constexpr auto RequestTimeout = std::chrono::seconds(30);
+/// Wait before reconnecting after an error, so a server that refuses connections is not hammered
+constexpr auto ReconnectDelay = std::chrono::milliseconds(10);
+
+enum Operation : std::size_t
+{
+    Create,
+    Login,
+    Test,
+    WebSocketPing,
+    OperationCount
+};
+
+constexpr std::array<std::string_view, OperationCount> OperationNames{"create", "login", "test", "ws-ping"};
+
+struct LoadOptions
+{
+    std::string host = "127.0.0.1";
+    unsigned short port = 8080;
+    int threads = 1;
+    std::size_t connections = 32;
+    std::size_t wsConnections = 0;
+    std::chrono::seconds duration{10};
+    std::chrono::seconds warmup{2};
+    std::size_t users = 32;
+    /// Relative share of create, login and test requests on the HTTP connections
+    std::array<unsigned, WebSocketPing> weights{1, 4, 16};
+    std::string output;
+};
+
+/// Latencies in microseconds of the successful requests of one operation, and the number that failed
+struct Samples
+{
+    std::vector<std::uint32_t> latencies;
+    std::uint64_t errors = 0;
+};
+
+using SampleSet = std::array<Samples, OperationCount>;
+
+struct Credentials
+{
+    std::string username;
+    std::string password;
+};
+
+/// Everything the clients share. It is written before they start and only read afterwards.
+struct Workload
+{
+    LoadOptions options;
+    tcp::endpoint endpoint;
+    std::string runId;
+    std::vector<Credentials> users;
+    std::string token;
+    /// Requests started before this are warmup and not recorded
+    Clock::time_point measureFrom;
+    /// Clients start no request from here on
+    Clock::time_point end;
+
+    bool measuring(Clock::time_point started) const
+    {
+        return started >= measureFrom && started < end;
+    }
+
+    Operation pick(std::mt19937 &random) const
+    {
+        std::discrete_distribution<std::size_t> distribution(options.weights.begin(), options.weights.end());
+        return static_cast<Operation>(distribution(random));
+    }
+};
+
+std::string credentialsBody(const std::string &username, const std::string &password)
+{
+    return json{{"username", username}, {"password", password}}.dump();
+}
+
+/**
+ * @brief Sends one request after another over a keep-alive connection, picking each from the configured mix.
+ * The connection is replaced when the server closes it or a request fails.
+ */
+class HttpClient : public std::enable_shared_from_this<HttpClient>
+{
+public:
+    HttpClient(net::io_context &context, const Workload &workload, std::size_t index, SampleSet &samples)
+        : stream_(net::make_strand(context)), timer_(stream_.get_executor()), workload_(workload), index_(index),
+          samples_(samples), random_(static_cast<std::mt19937::result_type>(index + 1))
+    {
+    }
+
+    void start()
+    {
+        net::dispatch(stream_.get_executor(), beast::bind_front_handler(&HttpClient::connect, shared_from_this()));
+    }
+
+private:
+    void connect()
+    {
+        stream_.expires_after(RequestTimeout);
+        stream_.async_connect(workload_.endpoint,
+                             beast::bind_front_handler(&HttpClient::onConnect, shared_from_this()));
+    }
+
+    void onConnect(beast::error_code ec)
+    {
+        if (ec)
+            return fail();
+        next();
+    }
+
+    void next()
+    {
+        inFlight_ = false;
+        if (Clock::now() >= workload_.end)
+        {
+            beast::error_code ec;
+            stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+            return;
+        }
+
+        operation_ = workload_.pick(random_);
+        prepareRequest();
+        inFlight_ = true;
+        started_ = Clock::now();
+        stream_.expires_after(RequestTimeout);
+        http::async_write(stream_, request_, beast::bind_front_handler(&HttpClient::onWrite, shared_from_this()));
+    }
+
+    void prepareRequest()
+    {
+        request_ = {};
+        request_.method(http::verb::post);
+        request_.set(http::field::host, workload_.options.host);
+        request_.set(http::field::content_type, "application/json");
+        request_.keep_alive(true);
+
+        const auto &user = workload_.users[random_() % workload_.users.size()];
+        switch (operation_)
+        {
+        case Create:
+            request_.target("/user/create");
+            request_.body() =
+                credentialsBody(fmt::format("{}-{}-{}", workload_.runId, index_, ++created_), user.password);
+            break;
+        case Login:
+            request_.target("/user/login");
+            request_.body() = credentialsBody(user.username, user.password);
+            break;
+        default:
+            request_.target("/test");
+            request_.set(http::field::authorization, "Bearer " + workload_.token);
+            request_.body() = json{{"username", user.username}}.dump();
+            break;
+        }
+        request_.prepare_payload();
+    }
+
+    void onWrite(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail();
+
+        response_ = {};
+        http::async_read(
+            stream_, buffer_, response_, beast::bind_front_handler(&HttpClient::onRead, shared_from_this()));
+    }
+
+    void onRead(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail();
+
+        record(response_.result_int() < 400);
+        if (!response_.keep_alive())
+            return reconnect();
+        next();
+    }
+
+    void record(bool success)
+    {
+        if (!workload_.measuring(started_))
+            return;
+
+        auto &operationSamples = samples_[operation_];
+        if (success)
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started_).count();
+            operationSamples.latencies.push_back(static_cast<std::uint32_t>(elapsed));
+        }
+        else
+        {
+            ++operationSamples.errors;
+        }
+    }
+
+    void fail()
+    {
+        if (inFlight_)
+            record(false);
+        inFlight_ = false;
+        reconnect();
+    }
+
+    void reconnect()
+    {
+        beast::error_code ignored;
+        stream_.socket().shutdown(tcp::socket::shutdown_both, ignored);
+        stream_.close();
+        buffer_.clear();
+        if (Clock::now() >= workload_.end)
+            return;
+
+        timer_.expires_after(ReconnectDelay);
+        timer_.async_wait(
+            [self = shared_from_this()](beast::error_code ec)
+            {
+                if (!ec)
+                    self->connect();
+            });
+    }
+
+    beast::tcp_stream stream_;
+    net::steady_timer timer_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> request_;
+    http::response<http::string_body> response_;
+    const Workload &workload_;
+    std::size_t index_;
+    SampleSet &samples_;
+    std::mt19937 random_;
+    std::uint64_t created_ = 0;
+    Operation operation_ = Test;
+    Clock::time_point started_;
+    bool inFlight_ = false;
+};
+
+/**
+ * @brief Sends a ping command over a websocket and waits for the reply before sending the next.
+ * A client that fails records the error and stops.
+ */
+class WebSocketClient : public std::enable_shared_from_this<WebSocketClient>
+{
+public:
+    WebSocketClient(net::io_context &context, const Workload &workload, SampleSet &samples)
+        : ws_(net::make_strand(context)), workload_(workload), samples_(samples)
+    {
+    }
+
+    void start()
+    {
+        beast::get_lowest_layer(ws_).expires_after(RequestTimeout);
+        beast::get_lowest_layer(ws_).async_connect(
+            workload_.endpoint, beast::bind_front_handler(&WebSocketClient::onConnect, shared_from_this()));
+    }
+
+private:
+    void onConnect(beast::error_code ec)
+    {
+        if (ec)
+            return fail();
+
+        // The websocket stream keeps its own timeouts from here on
+        beast::get_lowest_layer(ws_).expires_never();
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+        ws_.async_handshake(workload_.options.host,
+                            "/",
+                            beast::bind_front_handler(&WebSocketClient::onHandshake, shared_from_this()));
+    }
+
+    void onHandshake(beast::error_code ec)
+    {
+        if (ec)
+            return fail();
+        next();
+    }
+
+    void next()
+    {
+        inFlight_ = false;
+        if (Clock::now() >= workload_.end)
+        {
+            ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+            return;
+        }
+
+        message_ = fmt::format(R"({{"command":"ping","id":{}}})", ++sent_);
+        inFlight_ = true;
+        started_ = Clock::now();
+        ws_.async_write(net::buffer(message_),
+                        beast::bind_front_handler(&WebSocketClient::onWrite, shared_from_this()));
+    }
+
+    void onWrite(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail();
+        ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketClient::onRead, shared_from_this()));
+    }
+
+    void onRead(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail();
+
+        buffer_.consume(buffer_.size());
+        if (workload_.measuring(started_))
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started_).count();
+            samples_[WebSocketPing].latencies.push_back(static_cast<std::uint32_t>(elapsed));
+        }
+        next();
+    }
+
+    void fail()
+    {
+        if (inFlight_ && workload_.measuring(started_))
+            ++samples_[WebSocketPing].errors;
+        inFlight_ = false;
+    }
+
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    std::string message_;
+    const Workload &workload_;
+    SampleSet &samples_;
+    std::uint64_t sent_ = 0;
+    Clock::time_point started_;
+    bool inFlight_ = false;
+};
+
+/**
+ * @brief Create the users the login and test requests use, over one blocking connection. Users left over from an
+ * earlier run with the same names are logged in instead.
+ *
+ * @return A token for the test requests
+ * @throws std::runtime_error if a user can neither be created nor logged in
+ */
+std::string prepareUsers(const Workload &workload)
+{
+    net::io_context context;
+    beast::tcp_stream stream(context);
+    stream.connect(workload.endpoint);
+    beast::flat_buffer buffer;
+
+    auto post = [&](const char *target, const std::string &body)
+    {
+        for (;;)
+        {
+            http::request<http::string_body> request{http::verb::post, target, 11};
+            request.set(http::field::host, workload.options.host);
+            request.set(http::field::content_type, "application/json");
+            request.body() = body;
+            request.prepare_payload();
+            http::write(stream, request);
+
+            http::response<http::string_body> response;
+            http::read(stream, buffer, response);
+            if (!response.keep_alive())
+            {
+                stream.close();
+                stream.connect(workload.endpoint);
+            }
+            // The hashing queue is full, wait for it like a well behaved client
+            if (response.result() != http::status::service_unavailable)
+                return response;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    };
+
+    std::string token;
+    for (const auto &user : workload.users)
+    {
+        auto body = credentialsBody(user.username, user.password);
+        auto response = post("/user/create", body);
+        if (response.result() != http::status::ok)
+            response = post("/user/login", body);
+        if (response.result() != http::status::ok)
+        {
+            throw std::runtime_error(fmt::format(
+                "Failed to create or log in {}: {} {}", user.username, response.result_int(), response.body()));
+        }
+        if (token.empty())
+            token = json::parse(response.body()).at("result").at("token").get<std::string>();
+    }
+    return token;
+}
+
+double percentileMilliseconds(const std::vector<std::uint32_t> &sorted, double percentile)
+{
+    if (sorted.empty())
+        return 0.0;
+    auto rank = static_cast<std::size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1] / 1000.0;
+}
+
+/**
+ * @brief Print a table of the results and return them as JSON.
+ */
+json report(const Workload &workload, SampleSet &totals)
+{
+    auto seconds = std::chrono::duration<double>(workload.options.duration).count();
+    json operations = json::object();
+
+    fmt::print("{:<10} {:>10} {:>8} {:>10} {:>9} {:>9} {:>9} {:>9}\n",
+               "operation",
+               "requests",
+               "errors",
+               "req/s",
+               "p50 ms",
+               "p99 ms",
+               "p999 ms",
+               "max ms");
+    for (std::size_t i = 0; i < OperationCount; ++i)
+    {
+        auto &latencies = totals[i].latencies;
+        if (latencies.empty() && totals[i].errors == 0)
+            continue;
+
+        std::sort(latencies.begin(), latencies.end());
+        auto throughput = static_cast<double>(latencies.size()) / seconds;
+        auto p50 = percentileMilliseconds(latencies, 50.0);
+        auto p99 = percentileMilliseconds(latencies, 99.0);
+        auto p999 = percentileMilliseconds(latencies, 99.9);
+        auto max = percentileMilliseconds(latencies, 100.0);
+        fmt::print("{:<10} {:>10} {:>8} {:>10.1f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}\n",
+                   OperationNames[i],
+                   latencies.size(),
+                   totals[i].errors,
+                   throughput,
+                   p50,
+                   p99,
+                   p999,
+                   max);
+
+        operations[std::string(OperationNames[i])] = {
+            {"requests", latencies.size()},
+            {"errors", totals[i].errors},
+            {"throughput", throughput},
+            {"latencyMs", {{"p50", p50}, {"p99", p99}, {"p999", p999}, {"max", max}}}};
+    }
+
+    const auto &options = workload.options;
+    return {{"host", options.host},
+            {"port", options.port},
+            {"threads", options.threads},
+            {"connections", options.connections},
+            {"wsConnections", options.wsConnections},
+            {"durationSeconds", options.duration.count()},
+            {"warmupSeconds", options.warmup.count()},
+            {"mix",
+             {{"create", options.weights[Create]},
+              {"login", options.weights[Login]},
+              {"test", options.weights[Test]}}},
+            {"operations", operations}};
+}
+
+/// Parse a mix like create=1,login=4,test=16. Operations that are left out get no requests.
+std::array<unsigned, WebSocketPing> parseMix(const std::string &mix)
+{
+    std::array<unsigned, WebSocketPing> weights{};
+    std::size_t position = 0;
+    while (position < mix.size())
+    {
+        auto comma = std::min(mix.find(',', position), mix.size());
+        std::string_view entry(mix.data() + position, comma - position);
+        position = comma + 1;
+
+        auto equals = entry.find('=');
+        auto name = entry.substr(0, equals);
+        auto found = std::find(OperationNames.begin(), OperationNames.begin() + WebSocketPing, name);
+        if (equals == std::string_view::npos || found == OperationNames.begin() + WebSocketPing)
+            throw std::invalid_argument(fmt::format("Invalid mix entry: {}", entry));
+        weights[static_cast<std::size_t>(found - OperationNames.begin())] =
+            static_cast<unsigned>(std::stoul(std::string(entry.substr(equals + 1))));
+    }
+    if (std::all_of(weights.begin(), weights.end(), [](unsigned weight) { return weight == 0; }))
+        throw std::invalid_argument("The mix must give at least one operation a weight");
+    return weights;
+}
+
+std::optional<LoadOptions> parseOptions(int argc, char *argv[])
+{
+    LoadOptions config;
+    cxxopts::Options options("ccfolio-load",
+                             "Load generator for the ccfolio API. Every connection sends its next request as soon as "
+                             "the previous one is answered, so latencies are those of a closed-loop workload.");
+    // clang-format off
+    options.add_options()
+        ("host", "Server address", cxxopts::value<std::string>()->default_value(config.host))
+        ("p,port", "Server port", cxxopts::value<unsigned short>()->default_value(std::to_string(config.port)))
+        ("t,threads", "Client threads", cxxopts::value<int>()->default_value(std::to_string(config.threads)))
+        ("c,connections", "Keep-alive HTTP connections", cxxopts::value<std::size_t>()->default_value(std::to_string(config.connections)))
+        ("w,ws-connections", "Websocket connections sending ping commands", cxxopts::value<std::size_t>()->default_value(std::to_string(config.wsConnections)))
+        ("d,duration", "Seconds to measure for", cxxopts::value<int>()->default_value(std::to_string(config.duration.count())))
+        ("warmup", "Seconds to send requests before measuring", cxxopts::value<int>()->default_value(std::to_string(config.warmup.count())))
+        ("users", "Users created up front for the login and test requests", cxxopts::value<std::size_t>()->default_value(std::to_string(config.users)))
+        ("mix", "Relative share of each HTTP request, e.g. create=1,login=4,test=16", cxxopts::value<std::string>()->default_value("create=1,login=4,test=16"))
+        ("o,output", "Also write the results to this file as JSON", cxxopts::value<std::string>()->default_value(config.output))
+        ("h,help", "Print usage");
+    // clang-format on
+
+    auto result = options.parse(argc, argv);
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        return std::nullopt;
+    }
+
+    config.host = result["host"].as<std::string>();
+    config.port = result["port"].as<unsigned short>();
+    config.threads = std::max(1, result["threads"].as<int>());
+    config.connections = result["connections"].as<std::size_t>();
+    config.wsConnections = result["ws-connections"].as<std::size_t>();
+    config.duration = std::chrono::seconds(std::max(1, result["duration"].as<int>()));
+    config.warmup = std::chrono::seconds(std::max(0, result["warmup"].as<int>()));
+    config.users = std::max<std::size_t>(1, result["users"].as<std::size_t>());
+    config.weights = parseMix(result["mix"].as<std::string>());
+    config.output = result["output"].as<std::string>();
+    if (config.connections == 0 && config.wsConnections == 0)
+        throw std::invalid_argument("Nothing to do without connections or ws-connections");
+    return config;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Workload workload;
+    try
+    {
+        auto options = parseOptions(argc, argv);
+        if (!options)
+            return EXIT_SUCCESS;
+        workload.options = *options;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto &options = workload.options;
+    try
+    {
+        net::io_context resolverContext;
+        tcp::resolver resolver(resolverContext);
+        workload.endpoint = *resolver.resolve(options.host, std::to_string(options.port)).begin();
+
+        // Names unique to this run, so runs against the same server do not collide
+        workload.runId = fmt::format("load{:08x}", std::random_device{}());
+        for (std::size_t i = 0; i < options.users; ++i)
+            workload.users.push_back({fmt::format("{}-user{}", workload.runId, i), "load-test-password"});
+
+        if (options.connections > 0)
+        {
+            fmt::print("Creating {} users\n", options.users);
+            workload.token = prepareUsers(workload);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Setup failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("Running {} HTTP and {} websocket connections on {} threads for {}s after {}s of warmup\n",
+               options.connections,
+               options.wsConnections,
+               options.threads,
+               options.duration.count(),
+               options.warmup.count());
+
+    net::io_context context(options.threads);
+    workload.measureFrom = Clock::now() + options.warmup;
+    workload.end = workload.measureFrom + options.duration;
+
+    // Every client records into its own set, they are merged once the clients are done
+    std::vector<SampleSet> samples(options.connections + options.wsConnections);
+    for (std::size_t i = 0; i < options.connections; ++i)
+        std::make_shared<HttpClient>(context, workload, i, samples[i])->start();
+    for (std::size_t i = 0; i < options.wsConnections; ++i)
+        std::make_shared<WebSocketClient>(context, workload, samples[options.connections + i])->start();
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < options.threads; ++i)
+        threads.emplace_back([&context] { context.run(); });
+    context.run();
+    for (auto &thread : threads)
+        thread.join();
+
+    SampleSet totals;
+    for (auto &set : samples)
+    {
+        for (std::size_t i = 0; i < OperationCount; ++i)
+        {
+            auto &latencies = set[i].latencies;
+            totals[i].latencies.insert(totals[i].latencies.end(), latencies.begin(), latencies.end());
+            totals[i].errors += set[i].errors;
+        }
+    }
+
+    auto results = report(workload, totals);
+    if (!options.output.empty())
+    {
+        std::ofstream file(options.output);
+        file << results.dump(2) << std::endl;
+        if (!file)
+        {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
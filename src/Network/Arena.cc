@@ -0,0 +1,122 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+std::atomic<std::uint64_t> MonotonicArena::totalResets{0};
+std::atomic<std::uint64_t> MonotonicArena::totalAllocations{0};
+std::atomic<std::uint64_t> MonotonicArena::totalUpstreamAllocations{0};
+std::atomic<std::uint64_t> MonotonicArena::totalBytesAllocated{0};
+
+MonotonicArena::MonotonicArena(std::size_t blockSize, std::size_t retainLimit)
+    : blockSize_(blockSize), retainLimit_(retainLimit)
+{
+    head_ = current_ = addBlock(blockSize_);
+}
+
+MonotonicArena::~MonotonicArena()
+{
+    while (head_ != nullptr)
+    {
+        auto next = head_->next;
+        std::free(head_);
+        head_ = next;
+    }
+}
+
+/**
+     * @brief Allocate bytes from the current block, moving to a retained or new block when it is exhausted.
+     *
+     * @param bytes Number of bytes to allocate
+     * @param alignment Required alignment, must be a power of two
+     * @return Pointer to the allocated memory
+     */
+void *MonotonicArena::allocate(std::size_t bytes, std::size_t alignment)
+{
+    ++allocations_;
+    bytesAllocated_ += bytes;
+
+    for (;;)
+    {
+        auto base = reinterpret_cast<std::uintptr_t>(current_->data());
+        auto aligned = (base + offset_ + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+        auto start = static_cast<std::size_t>(aligned - base);
+
+        if (start + bytes <= current_->size)
+        {
+            offset_ = start + bytes;
+            return current_->data() + start;
+        }
+
+        if (current_->next != nullptr && current_->next->size >= bytes + alignment)
+        {
+            current_ = current_->next;
+        }
+        else
+        {
+            auto block = addBlock(std::max(blockSize_, bytes + alignment));
+            block->next = current_->next;
+            current_->next = block;
+            current_ = block;
+        }
+        offset_ = 0;
+    }
+}
+
+/**
+     * @brief Give back the most recent allocation. Any other deallocation is deferred to reset().
+     */
+void MonotonicArena::deallocate(void *p, std::size_t bytes) noexcept
+{
+    auto end = static_cast<unsigned char *>(p) + bytes;
+    if (end == current_->data() + offset_)
+        offset_ -= bytes;
+}
+
+/**
+     * @brief Release every allocation and rewind to the first block.
+     * Blocks beyond the retain limit are returned to the heap.
+     */
+void MonotonicArena::reset() noexcept
+{
+    totalResets.fetch_add(1, std::memory_order_relaxed);
+    totalAllocations.fetch_add(allocations_, std::memory_order_relaxed);
+    totalUpstreamAllocations.fetch_add(upstreamAllocations_, std::memory_order_relaxed);
+    totalBytesAllocated.fetch_add(bytesAllocated_, std::memory_order_relaxed);
+
+    std::size_t retained = 0;
+    for (auto block = head_; block != nullptr; block = block->next)
+    {
+        retained += block->size;
+        while (block->next != nullptr && retained + block->next->size > retainLimit_)
+        {
+            auto drop = block->next;
+            block->next = drop->next;
+            std::free(drop);
+        }
+    }
+
+    current_ = head_;
+    offset_ = 0;
+    allocations_ = 0;
+    upstreamAllocations_ = 0;
+    bytesAllocated_ = 0;
+}
+
+MonotonicArena::Stats MonotonicArena::globalStats() noexcept
+{
+    return {totalResets.load(std::memory_order_relaxed),
+            totalAllocations.load(std::memory_order_relaxed),
+            totalUpstreamAllocations.load(std::memory_order_relaxed),
+            totalBytesAllocated.load(std::memory_order_relaxed)};
+}
+
+MonotonicArena::Block *MonotonicArena::addBlock(std::size_t minSize)
+{
+    auto memory = std::malloc(sizeof(Block) + minSize);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+
+    ++upstreamAllocations_;
+    return new (memory) Block{nullptr, minSize};
+}
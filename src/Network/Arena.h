@@ -0,0 +1,143 @@
+//
+// Created by fred on 4/14/24.
+//
+
+#ifndef CCFOLIO_ARENA_H
+#define CCFOLIO_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Bump allocator that hands out memory from a chain of blocks and frees it all at once.
+ *
+ * Individual deallocations are no-ops, except that releasing the most recent allocation gives its bytes back, so
+ * the freed tail is reused by the next allocation. reset() rewinds to the first block and keeps up to retainLimit
+ * bytes of blocks around, so a warmed-up arena serves a request without touching the heap.
+ * An arena is not thread safe and must only be used from the connection that owns it.
+ */
+class MonotonicArena
+{
+public:
+    /// Process wide counters, updated on every reset()
+    struct Stats
+    {
+        std::uint64_t resets;
+        std::uint64_t allocations;
+        std::uint64_t upstreamAllocations;
+        std::uint64_t bytesAllocated;
+    };
+
+    explicit MonotonicArena(std::size_t blockSize = 4096, std::size_t retainLimit = 64 * 1024);
+    ~MonotonicArena();
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    void *allocate(std::size_t bytes, std::size_t alignment);
+    void deallocate(void *p, std::size_t bytes) noexcept;
+    void reset() noexcept;
+
+    /// Number of allocate() calls since the last reset
+    std::size_t allocationCount() const noexcept
+    {
+        return allocations_;
+    }
+
+    /// Number of blocks requested from the heap since the last reset
+    std::size_t upstreamAllocationCount() const noexcept
+    {
+        return upstreamAllocations_;
+    }
+
+    /// Bytes handed out since the last reset
+    std::size_t bytesAllocated() const noexcept
+    {
+        return bytesAllocated_;
+    }
+
+    static Stats globalStats() noexcept;
+
+private:
+    struct Block
+    {
+        Block *next;
+        std::size_t size;
+
+        unsigned char *data() noexcept
+        {
+            return reinterpret_cast<unsigned char *>(this + 1);
+        }
+    };
+
+    Block *addBlock(std::size_t minSize);
+
+    std::size_t blockSize_;
+    std::size_t retainLimit_;
+    Block *head_ = nullptr;
+    Block *current_ = nullptr;
+    std::size_t offset_ = 0;
+    std::size_t allocations_ = 0;
+    std::size_t upstreamAllocations_ = 0;
+    std::size_t bytesAllocated_ = 0;
+
+    static std::atomic<std::uint64_t> totalResets;
+    static std::atomic<std::uint64_t> totalAllocations;
+    static std::atomic<std::uint64_t> totalUpstreamAllocations;
+    static std::atomic<std::uint64_t> totalBytesAllocated;
+};
+
+/**
+ * @brief Standard allocator adaptor over a MonotonicArena.
+ *
+ * @tparam T The value type
+ */
+template <class T>
+class ArenaAllocator
+{
+    template <class U>
+    friend class ArenaAllocator;
+
+    MonotonicArena *arena_;
+
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(MonotonicArena &arena) noexcept : arena_(&arena)
+    {
+    }
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena_(other.arena_)
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        arena_->deallocate(p, n * sizeof(T));
+    }
+
+    MonotonicArena &arena() const noexcept
+    {
+        return *arena_;
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept
+    {
+        return arena_ != other.arena_;
+    }
+};
+
+#endif //CCFOLIO_ARENA_H
@@ -0,0 +1,202 @@
+#include "BroadcastGroup.h"
+#include "WebSocketSession.h"
+#include <algorithm>
+
+using Strand = net::strand<net::io_context::executor_type>;
+
+struct BroadcastGroup::Shard
+{
+    struct Member
+    {
+        // Identifies the member in leave(), which runs in the destructor when the weak pointer has already expired
+        WebSocketSession *session;
+        // The last owner may be released on any thread, e.g. by a WebSocketContext, so delivery must hold a
+        // reference of its own even for direct members
+        boost::weak_ptr<WebSocketSession> weakSession;
+        bool direct;
+    };
+    using MemberList = std::vector<Member>;
+    using MessageList = std::vector<boost::shared_ptr<std::string const>>;
+
+    Shard(net::execution_context &shardContext, net::any_io_executor shardExecutor)
+        : context(&shardContext), executor(std::move(shardExecutor)), members(std::make_shared<const MemberList>())
+    {
+    }
+
+    /**
+     * @brief Queue a message for the members. At most one delivery handler is scheduled at a time, so messages
+     * reach every member in the order they were broadcast even when several threads run the context.
+     */
+    void enqueue(std::shared_ptr<Shard> const &self, boost::shared_ptr<std::string const> message)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.push_back(std::move(message));
+            if (scheduled)
+                return;
+            scheduled = true;
+        }
+        net::post(executor, [self] { self->deliverPending(); });
+    }
+
+    void deliverPending()
+    {
+        for (;;)
+        {
+            MessageList batch;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                if (pending.empty())
+                {
+                    scheduled = false;
+                    return;
+                }
+                batch.swap(pending);
+            }
+
+            deliver(*std::atomic_load(&members), std::make_shared<MessageList const>(std::move(batch)));
+        }
+    }
+
+    /**
+     * @brief Hand a batch of messages to every member, locking each member once per batch. Direct members are
+     * called inline; every strand member gets a dispatch of its own, one handler per member and batch.
+     */
+    static void deliver(MemberList const &list, std::shared_ptr<MessageList const> const &messages)
+    {
+        for (auto const &member : list)
+        {
+            auto session = member.weakSession.lock();
+            if (!session)
+                continue;
+
+            if (member.direct)
+            {
+                for (auto const &message : *messages)
+                    session->on_send(message);
+            }
+            else
+            {
+                net::dispatch(session->executor(),
+                              [session, messages]
+                              {
+                                  for (auto const &message : *messages)
+                                      session->on_send(message);
+                              });
+            }
+        }
+    }
+
+    std::size_t size() const
+    {
+        return std::atomic_load(&members)->size();
+    }
+
+    net::execution_context *const context;
+    net::any_io_executor const executor;
+
+    std::mutex writeMutex;
+    std::shared_ptr<const MemberList> members;
+
+    std::mutex pendingMutex;
+    MessageList pending;
+    bool scheduled = false;
+};
+
+BroadcastGroup::BroadcastGroup() : shards_(std::make_shared<const ShardList>())
+{
+}
+
+BroadcastGroup::~BroadcastGroup() = default;
+
+/**
+     * @brief Find or create the shard for an executor's execution context.
+     * Shards are never removed, there is one per io_context.
+     */
+std::shared_ptr<BroadcastGroup::Shard> BroadcastGroup::shardFor(const net::any_io_executor &executor)
+{
+    auto &context = net::query(executor, net::execution::context);
+
+    std::lock_guard<std::mutex> lock(shardsMutex_);
+    for (auto const &shard : *shards_)
+        if (shard->context == &context)
+            return shard;
+
+    // Post to the io_context itself, not to whichever session's strand created the shard
+    net::any_io_executor shardExecutor = executor;
+    if (auto strand = executor.target<Strand>())
+        shardExecutor = strand->get_inner_executor();
+
+    auto shard = std::make_shared<Shard>(context, std::move(shardExecutor));
+    auto shards = std::make_shared<ShardList>(*shards_);
+    shards->push_back(shard);
+    std::atomic_store(&shards_, std::shared_ptr<const ShardList>(std::move(shards)));
+    return shard;
+}
+
+/**
+     * @brief Add a session to the group. Must be called on the session's executor.
+     */
+void BroadcastGroup::join(WebSocketSession &session)
+{
+    auto executor = session.executor();
+    bool direct = executor.target<Strand>() == nullptr;
+    auto shard = shardFor(executor);
+
+    Shard::Member member{&session, session.weak_from_this(), direct};
+
+    std::lock_guard<std::mutex> lock(shard->writeMutex);
+    auto members = std::make_shared<Shard::MemberList>(*shard->members);
+    members->push_back(std::move(member));
+    std::atomic_store(&shard->members, std::shared_ptr<const Shard::MemberList>(std::move(members)));
+}
+
+/**
+     * @brief Remove a session from the group. Safe to call from the session's destructor.
+     */
+void BroadcastGroup::leave(WebSocketSession &session)
+{
+    auto &context = net::query(session.executor(), net::execution::context);
+    auto shards = std::atomic_load(&shards_);
+    auto it = std::find_if(
+        shards->begin(), shards->end(), [&context](auto const &shard) { return shard->context == &context; });
+    if (it == shards->end())
+        return;
+
+    auto &shard = **it;
+    std::lock_guard<std::mutex> lock(shard.writeMutex);
+    auto members = std::make_shared<Shard::MemberList>();
+    members->reserve(shard.members->size());
+    for (auto const &member : *shard.members)
+        if (member.session != &session)
+            members->push_back(member);
+    std::atomic_store(&shard.members, std::shared_ptr<const Shard::MemberList>(std::move(members)));
+}
+
+/**
+     * @brief Send a message to every member. Queues it on every non-empty shard and shares it between all members;
+     * the shard's delivery handler then reaches strand members with one dispatch each.
+     */
+void BroadcastGroup::broadcast(boost::shared_ptr<std::string const> const &message) const
+{
+    auto shards = std::atomic_load(&shards_);
+    for (auto const &shard : *shards)
+    {
+        if (shard->size() == 0)
+            continue;
+        shard->enqueue(shard, message);
+    }
+}
+
+std::size_t BroadcastGroup::size() const
+{
+    std::size_t total = 0;
+    for (auto const &shard : *std::atomic_load(&shards_))
+        total += shard->size();
+    return total;
+}
+
+std::size_t BroadcastGroup::shardCount() const
+{
+    return std::atomic_load(&shards_)->size();
+}
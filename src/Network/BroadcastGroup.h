@@ -0,0 +1,59 @@
+//
+// Created by fred on 4/26/24.
+//
+
+#ifndef CCFOLIO_BROADCASTGROUP_H
+#define CCFOLIO_BROADCASTGROUP_H
+
+#include "Net.h"
+#include <boost/smart_ptr.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class WebSocketSession;
+
+/**
+ * @brief Set of websocket sessions that receive the same messages.
+ *
+ * Sessions are sharded by the execution context they run on, and each shard keeps an immutable, copy-on-write list
+ * of its members. Joining or leaving copies the list of one shard; broadcasting queues the message on each shard,
+ * whose delivery handler walks the list on that context and hands every member the same message buffer.
+ *
+ * Messages queued while a delivery handler is pending are delivered together, and every member is locked through
+ * a weak pointer once per batch, so a session released on another thread is never called after its destruction.
+ * A member running directly on its io_context, as in ListenerMode::PerThread, is assumed to share the shard's
+ * single thread and is called inline. A member whose executor is a strand is reached by dispatching the batch onto
+ * its strand. Sessions on a shared io_context each have their own strand and on_send must run on it, so there a
+ * broadcast costs one handler per shard plus one per member and batch; only the per-thread mode delivers a batch
+ * to a whole shard from one handler.
+ */
+class BroadcastGroup
+{
+public:
+    BroadcastGroup();
+    ~BroadcastGroup();
+    BroadcastGroup(const BroadcastGroup &) = delete;
+    BroadcastGroup &operator=(const BroadcastGroup &) = delete;
+
+    void join(WebSocketSession &session);
+    void leave(WebSocketSession &session);
+    void broadcast(boost::shared_ptr<std::string const> const &message) const;
+
+    /// Number of members, summed over the shards without a common snapshot
+    std::size_t size() const;
+    std::size_t shardCount() const;
+
+private:
+    struct Shard;
+    using ShardList = std::vector<std::shared_ptr<Shard>>;
+
+    std::shared_ptr<Shard> shardFor(const net::any_io_executor &executor);
+
+    std::mutex shardsMutex_;
+    std::shared_ptr<const ShardList> shards_;
+};
+
+#endif //CCFOLIO_BROADCASTGROUP_H
@@ -0,0 +1,89 @@
+//
+// Created by fred on 4/28/24.
+//
+
+#ifndef CCFOLIO_DEFLATEOPTIONS_H
+#define CCFOLIO_DEFLATEOPTIONS_H
+
+#include "Beast.h"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+/// Newer versions of Beast can leave small messages uncompressed, older ones compress every message
+template <class Pmd, class = void>
+struct HasSizeThreshold : std::false_type
+{
+};
+
+template <class Pmd>
+struct HasSizeThreshold<Pmd, std::void_t<decltype(Pmd::msg_size_threshold)>> : std::true_type
+{
+};
+
+/**
+ * @brief Server settings for the websocket permessage-deflate extension.
+ *
+ * Every session that negotiates the extension keeps its own zlib streams for as long as it is open, so hosts with
+ * many idle connections pay memoryPerSession() for each of them. Smaller windows and memory levels cost ratio but
+ * save memory. Turning context takeover off resets the streams after every message, which lowers the ratio on
+ * streams of similar messages without freeing the memory.
+ */
+struct DeflateOptions
+{
+    bool enabled = true;
+    /// LZ77 window offered for both directions, 9 to 15
+    int windowBits = 15;
+    /// zlib compression level, 0 to 9
+    int compressionLevel = 6;
+    /// zlib memory level, 1 to 9
+    int memLevel = 4;
+    /// Messages smaller than this are sent uncompressed
+    std::size_t minMessageBytes = 256;
+    /// Keep the compression dictionary between messages
+    bool contextTakeover = true;
+
+    /// Whether this version of Beast can skip compression for small messages
+    static constexpr bool ThresholdSupported = HasSizeThreshold<websocket::permessage_deflate>::value;
+
+    websocket::permessage_deflate toBeast() const
+    {
+        websocket::permessage_deflate pmd;
+        pmd.server_enable = enabled;
+        // zlib cannot handle a window of 8 bits, see websocket::permessage_deflate
+        pmd.server_max_window_bits = std::clamp(windowBits, 9, 15);
+        pmd.client_max_window_bits = pmd.server_max_window_bits;
+        pmd.server_no_context_takeover = !contextTakeover;
+        pmd.client_no_context_takeover = !contextTakeover;
+        pmd.compLevel = std::clamp(compressionLevel, 0, 9);
+        pmd.memLevel = std::clamp(memLevel, 1, 9);
+        setThreshold(pmd, minMessageBytes);
+        return pmd;
+    }
+
+    /**
+     * @brief Estimated zlib memory held by one session with the extension, from zlib's own formulas:
+     * (1 << (windowBits + 2)) + (1 << (memLevel + 9)) to compress and (1 << windowBits) plus about 7 KiB to
+     * decompress.
+     */
+    std::size_t memoryPerSession() const
+    {
+        auto bits = std::clamp(windowBits, 9, 15);
+        auto level = std::clamp(memLevel, 1, 9);
+        std::size_t deflate = (std::size_t{1} << (bits + 2)) + (std::size_t{1} << (level + 9));
+        std::size_t inflate = (std::size_t{1} << bits) + 7 * 1024;
+        return deflate + inflate;
+    }
+
+private:
+    template <class Pmd>
+    static void setThreshold(Pmd &pmd, std::size_t bytes)
+    {
+        if constexpr (HasSizeThreshold<Pmd>::value)
+            pmd.msg_size_threshold = bytes;
+        else
+            (void)bytes;
+    }
+};
+
+#endif //CCFOLIO_DEFLATEOPTIONS_H
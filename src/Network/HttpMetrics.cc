@@ -0,0 +1,31 @@
+#include "HttpMetrics.h"
+#include <string>
+
+RouteMetrics::RouteMetrics(std::string_view method, std::string_view route)
+    : name_(std::string(method) + ' ' + std::string(route))
+{
+    auto &registry = MetricsRegistry::getInstance();
+    for (unsigned i = 0; i < responses_.size(); ++i)
+    {
+        responses_[i] = &registry.counter("http_responses_total",
+                                          "HTTP responses by route and status class",
+                                          {{"method", std::string(method)},
+                                           {"route", std::string(route)},
+                                           {"code", std::to_string(i + 1) + "xx"}});
+    }
+    latency_ = &registry.histogram("http_request_duration_seconds",
+                                   "Time from reading a request header to writing the last byte of its response",
+                                   {{"method", std::string(method)}, {"route", std::string(route)}});
+}
+
+HttpMetrics &HttpMetrics::getInstance()
+{
+    auto &registry = MetricsRegistry::getInstance();
+    static HttpMetrics instance{
+        registry.gauge("http_open_connections", "HTTP connections currently open, not counting websockets"),
+        registry.counter("http_accepted_connections_total", "Connections accepted by the listeners"),
+        registry.counter("http_accept_errors_total", "Failed accepts, e.g. when out of file descriptors"),
+        RouteMetrics("GET", "<static>"),
+        RouteMetrics("*", "<unmatched>")};
+    return instance;
+}
@@ -0,0 +1,62 @@
+//
+// Created by fred on 5/4/24.
+//
+
+#ifndef CCFOLIO_HTTPMETRICS_H
+#define CCFOLIO_HTTPMETRICS_H
+
+#include "Metrics.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Responses and latency of one route, labelled with its method and pattern rather than the request target,
+ * so the number of series stays bounded. Responses are counted by status class.
+ */
+class RouteMetrics
+{
+public:
+    /// Records nothing
+    RouteMetrics() = default;
+    RouteMetrics(std::string_view method, std::string_view route);
+
+    void record(unsigned status, std::chrono::steady_clock::duration elapsed) const noexcept
+    {
+        if (latency_ == nullptr)
+            return;
+
+        auto statusClass = std::clamp(status / 100, 1u, 5u);
+        responses_[statusClass - 1]->add();
+        latency_->record(elapsed);
+    }
+
+    /// Method and route pattern, e.g. "POST /user/login", which also names the route's request spans
+    std::string_view name() const noexcept
+    {
+        return name_;
+    }
+
+private:
+    std::array<Counter *, 5> responses_{};
+    Histogram *latency_ = nullptr;
+    std::string name_;
+};
+
+/// Process wide metrics of the HTTP server
+struct HttpMetrics
+{
+    Gauge &openConnections;
+    Counter &acceptedConnections;
+    Counter &acceptErrors;
+    /// Requests served from the document root
+    RouteMetrics staticFiles;
+    /// Requests that matched no route and no file
+    RouteMetrics unmatched;
+
+    static HttpMetrics &getInstance();
+};
+
+#endif //CCFOLIO_HTTPMETRICS_H
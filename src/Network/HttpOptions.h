@@ -0,0 +1,40 @@
+//
+// Created by fred on 5/1/24.
+//
+
+#ifndef CCFOLIO_HTTPOPTIONS_H
+#define CCFOLIO_HTTPOPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Per-connection settings for HTTP sessions.
+ *
+ * Every phase of a request has its own deadline, so a client that trickles bytes cannot hold a connection open
+ * for longer than the phase allows. Connections that run over a deadline or a size limit are closed at once.
+ */
+struct HttpOptions
+{
+    /// Requests a connection may have read but not yet answered. Reading pauses when the limit is reached.
+    std::size_t pipelineDepth = 8;
+
+    /// Time to receive the complete header of a request, counted from the first byte or from accepting
+    std::chrono::seconds headerTimeout{10};
+    /// Time to receive the body once the header is complete
+    std::chrono::seconds bodyTimeout{30};
+    /// Time a keep-alive connection may wait for the next request
+    std::chrono::seconds idleTimeout{30};
+    /// Time to write one response
+    std::chrono::seconds writeTimeout{30};
+
+    /// Largest request header accepted
+    std::uint32_t headerLimit = 8 * 1024;
+    /// Largest request body accepted, unless the route sets its own limit
+    std::uint64_t bodyLimit = 10000;
+    /// Requests served on one connection before it is closed, 0 for no limit
+    std::size_t maxRequestsPerConnection = 1000;
+};
+
+#endif //CCFOLIO_HTTPOPTIONS_H
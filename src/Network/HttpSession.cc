@@ -2,54 +2,65 @@
 #include "LogService.h"
 #include "WebSocketSession.h"
 #include "fmt/format.h"
+#include <algorithm>
 #include <boost/config.hpp>
+#include <cerrno>
 #include <iostream>
+#include <limits>
+#include <unistd.h>
 
-template <class Body, class Allocator, class Send>
-void handle_request(beast::string_view doc_root,
-                    http::request<Body, http::basic_fields<Allocator>> &&req,
-                    Send &&send,
-                    Router &router_)
-{
-    HttpResponse res_;
-
-    res_.version(req.version());
-    res_.keep_alive(req.keep_alive());
-
-    if (!router_.handleRequest(req, res_))
-    {
-        res_.result(http::status::not_found);
-        res_.set(http::field::content_type, "text/plain");
-        res_.body() = "Not Found";
-        res_.prepare_payload();
-    }
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
-    return send(std::move(res_));
+static void not_found(HttpResponse &res)
+{
+    res.result(http::status::not_found);
+    res.set(http::field::content_type, "text/plain");
+    res.body() = "Not Found";
+    res.prepare_payload();
 }
 
-struct HttpSession::send_lambda
+void HttpSession::Exchange::reset() noexcept
 {
-    HttpSession &self_;
+    // Everything allocated for this request goes back to the arena in one step
+    context.reset();
+    bodySpan = {};
+    span = {};
+    route = nullptr;
+    metrics = nullptr;
+    file = {};
+    serializer.reset();
+    response.reset();
+    streamParser.reset();
+    parser.reset();
+    arena.reset();
+    ready = false;
+    upgrade = false;
+    stream = false;
+}
 
-    explicit send_lambda(HttpSession &self) : self_(self)
-    {
-    }
+bool HttpSession::Exchange::bodyDone() const noexcept
+{
+    return streamParser ? streamParser->is_done() : parser->is_done();
+}
 
-    template <bool isRequest, class Body, class Fields>
-    void operator()(http::message<isRequest, Body, Fields> &&msg) const
-    {
-        auto sp = boost::make_shared<http::message<isRequest, Body, Fields>>(std::move(msg));
+std::atomic<std::uint64_t> HttpSession::shedTimeouts{0};
+std::atomic<std::uint64_t> HttpSession::shedLimits{0};
 
-        auto self = self_.shared_from_this();
-        http::async_write(self_.stream_, *sp, [self, sp](beast::error_code ec, std::size_t bytes) {
-            self->on_write(ec, bytes, sp->need_eof());
-        });
-    }
-};
+HttpSession::HttpSession(tcp::socket &&socket,
+                         boost::shared_ptr<SharedState> const &state,
+                         Router &router,
+                         WebSocketRouter const &webSocketRouter)
+    : stream_(std::move(socket)), state_(state), router_(router), webSocketRouter_(webSocketRouter),
+      pipeline_(std::max<std::size_t>(1, state->httpOptions().pipelineDepth))
+{
+    HttpMetrics::getInstance().openConnections.add(1);
+}
 
-HttpSession::HttpSession(tcp::socket &&socket, boost::shared_ptr<SharedState> const &state, Router &router)
-    : stream_(std::move(socket)), state_(state), router_(router)
+HttpSession::~HttpSession()
 {
+    HttpMetrics::getInstance().openConnections.add(-1);
 }
 
 void HttpSession::run()
@@ -62,63 +73,541 @@ void HttpSession::fail(beast::error_code ec, char const *what)
     if (ec == net::error::operation_aborted)
         return;
 
-    LOG(LogService::LogLevel::ERROR, fmt::format("{0}: {1}", what, ec.message()));
+    if (ec == beast::error::timeout || ec == http::error::header_limit || ec == http::error::body_limit)
+    {
+        // Expected from slow or oversized clients, so shed the connection without an error
+        (ec == beast::error::timeout ? shedTimeouts : shedLimits).fetch_add(1, std::memory_order_relaxed);
+        LOGF(LogService::LogLevel::DEBUG, "Closing connection, {0}: {1}", what, ec.message());
+        closed_ = true;
+        stream_.close();
+        return;
+    }
+
+    LOGF(LogService::LogLevel::ERROR, "{0}: {1}", what, ec.message());
 }
 
+/**
+     * @brief Start reading the next request, unless the pipeline is full. Reading resumes once a response has been
+     * written. Between requests the connection is idle until the first byte arrives.
+     */
 void HttpSession::do_read()
 {
-    parser_.emplace();
-    parser_->body_limit(10000);
-    stream_.expires_after(std::chrono::seconds(100));
+    // A streaming request is always the last one read, its body has to be consumed before the next header
+    if (pipeline_.full() || (!pipeline_.empty() && pipeline_.back()->stream))
+    {
+        readPaused_ = true;
+        return;
+    }
+
+    if (!spare_.empty())
+    {
+        reading_ = std::move(spare_.back());
+        spare_.pop_back();
+    }
+    else
+    {
+        reading_ = std::make_unique<Exchange>();
+    }
+
+    auto const &options = state_->httpOptions();
+    reading_->parser.emplace(
+        std::piecewise_construct, std::make_tuple(), std::make_tuple(RequestAllocator(reading_->arena)));
+    reading_->parser->header_limit(options.headerLimit);
+    // The body limit depends on the route, so it is only set once the header has been read. boost::none would
+    // make the parser reject every Content-Length while parsing the header.
+    reading_->parser->body_limit(std::numeric_limits<std::uint64_t>::max());
 
-    http::async_read(stream_,
-                     buffer_,
-                     parser_->get(),
-                     beast::bind_front_handler(&HttpSession::on_read, shared_from_this()));
+    if (requestCount_ == 0 || buffer_.size() != 0)
+        return read_header();
+
+    stream_.expires_after(options.idleTimeout);
+    stream_.async_read_some(buffer_.prepare(2048),
+                            beast::bind_front_handler(&HttpSession::on_idle, shared_from_this()));
 }
 
-void HttpSession::on_read(beast::error_code ec, std::size_t)
+void HttpSession::on_idle(beast::error_code ec, std::size_t bytes_transferred)
+{
+    if (ec == net::error::eof)
+        return on_end_of_stream();
+
+    if (ec)
+        return fail(ec, "idle");
+
+    buffer_.commit(bytes_transferred);
+    read_header();
+}
+
+void HttpSession::read_header()
+{
+    stream_.expires_after(state_->httpOptions().headerTimeout);
+    http::async_read_header(
+        stream_, buffer_, *reading_->parser, beast::bind_front_handler(&HttpSession::on_header, shared_from_this()));
+}
+
+void HttpSession::on_header(beast::error_code ec, std::size_t)
 {
     if (ec == http::error::end_of_stream)
+        return on_end_of_stream();
+
+    if (ec)
+        return fail(ec, "read header");
+
+    auto &exchange = *reading_;
+    const auto &req = exchange.parser->get();
+    exchange.started = std::chrono::steady_clock::now();
+    exchange.context.emplace(stream_.get_executor());
+    exchange.route = router_.match(
+        req.method(), std::string_view(req.target().data(), req.target().size()), *exchange.context);
+    if (exchange.route != nullptr)
+        exchange.metrics = &exchange.route->metrics;
+
+    if (auto &tracer = Tracer::getInstance(); tracer.enabled())
+    {
+        auto traceparent = req["traceparent"];
+        exchange.span = tracer.startRequest(exchange.metrics != nullptr ? exchange.metrics->name() : "HTTP request",
+                                            std::string_view(traceparent.data(), traceparent.size()));
+    }
+
+    auto bodyLimit = state_->httpOptions().bodyLimit;
+    if (exchange.route != nullptr && exchange.route->options.bodyLimit != 0)
+        bodyLimit = exchange.route->options.bodyLimit;
+    // The parser checks chunked bodies as they arrive, but compares Content-Length only while parsing the header
+    exchange.parser->body_limit(bodyLimit);
+    if (auto length = exchange.parser->content_length(); length && *length > bodyLimit)
+        return fail(http::error::body_limit, "read header");
+
+    if (exchange.route != nullptr && exchange.route->isStreaming())
+    {
+        // The handler reads the body itself once the responses before it are written, and reading the next
+        // request resumes after its response
+        exchange.stream = true;
+        exchange.ready = true;
+        readPaused_ = enqueue();
+        return do_write();
+    }
+
+    exchange.bodySpan = Span("http.read_body", exchange.span.context());
+    stream_.expires_after(state_->httpOptions().bodyTimeout);
+    http::async_read(
+        stream_, buffer_, *exchange.parser, beast::bind_front_handler(&HttpSession::on_read, shared_from_this()));
+}
+
+/**
+     * @brief The client closed its sending side. Answer what is already in the pipeline before closing ours.
+     */
+void HttpSession::on_end_of_stream()
+{
+    readDone_ = true;
+    if (pipeline_.empty())
     {
+        beast::error_code ec;
         stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
-        return;
     }
+}
 
+void HttpSession::on_read(beast::error_code ec, std::size_t)
+{
     if (ec)
         return fail(ec, "read");
 
-    if (websocket::is_upgrade(parser_->get()))
+    auto &exchange = *reading_;
+    exchange.bodySpan.end();
+    enqueue();
+
+    const auto &req = exchange.parser->get();
+    if (websocket::is_upgrade(req))
     {
-        boost::make_shared<WebSocketSession>(stream_.release_socket(), state_)->run(parser_->release());
+        // The upgrade waits for the responses before it, and nothing more is read over HTTP
+        exchange.upgrade = true;
+        exchange.ready = true;
+        readDone_ = true;
+        return do_write();
+    }
+
+    RequestAllocator alloc(exchange.arena);
+    exchange.response.emplace(std::piecewise_construct, std::make_tuple(alloc), std::make_tuple(alloc));
+    exchange.response->version(req.version());
+    exchange.response->keep_alive(!readDone_);
+
+    // Synchronous handlers complete before invoke returns, asynchronous ones may complete on another thread.
+    // Either way the exchange is marked ready on the connection's executor, and writes start from there in order.
+    auto completion = [self = shared_from_this(), executor = stream_.get_executor(), exchange = &exchange]
+    {
+        net::dispatch(executor,
+                      [self, exchange]
+                      {
+                          exchange->ready = true;
+                          self->do_write();
+                      });
+    };
+
+    auto const &files = state_->staticFiles();
+    if (exchange.route != nullptr)
+    {
+        // Spans started by the handler and the middleware in front of it become children of the request's span
+        TraceScope traceScope(exchange.span.context());
+        Router::invoke(*exchange.route, req, *exchange.response, *exchange.context, std::move(completion));
+    }
+    else if (files.enabled() && (req.method() == http::verb::get || req.method() == http::verb::head) &&
+             files.serve(req, *exchange.response, exchange.file))
+    {
+        exchange.metrics = &HttpMetrics::getInstance().staticFiles;
+        exchange.span.setName(exchange.metrics->name());
+        exchange.ready = true;
+        do_write();
+    }
+    else
+    {
+        not_found(*exchange.response);
+        exchange.metrics = &HttpMetrics::getInstance().unmatched;
+        exchange.span.setName(exchange.metrics->name());
+        exchange.ready = true;
+        do_write();
+    }
+
+    // Keep parsing pipelined requests while earlier ones are handled and written
+    if (!readDone_)
+        do_read();
+}
+
+/**
+     * @brief Move the request that is being read to the back of the pipeline.
+     * The last request a connection may serve is answered with Connection: close.
+     *
+     * @return Whether more requests may be read after it
+     */
+bool HttpSession::enqueue()
+{
+    const auto &req = reading_->parser->get();
+    auto maxRequests = state_->httpOptions().maxRequestsPerConnection;
+    ++requestCount_;
+    readDone_ = !req.keep_alive() || (maxRequests != 0 && requestCount_ >= maxRequests);
+    pipeline_.push_back(std::move(reading_));
+    return !readDone_;
+}
+
+/**
+     * @brief Write the response at the front of the pipeline if it is ready and no other write is in progress.
+     */
+void HttpSession::do_write()
+{
+    if (writing_ || closed_ || pipeline_.empty() || !pipeline_.front()->ready)
         return;
+
+    auto &exchange = *pipeline_.front();
+    if (exchange.upgrade)
+        return upgrade(exchange);
+
+    writing_ = true;
+    if (exchange.stream)
+        return start_stream(exchange);
+
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    auto close = exchange.response->need_eof();
+    if (exchange.file.file)
+    {
+        exchange.serializer.emplace(*exchange.response);
+        return http::async_write_header(
+            stream_,
+            *exchange.serializer,
+            beast::bind_front_handler(&HttpSession::on_file_header, shared_from_this(), close));
+    }
+
+    http::async_write(
+        stream_, *exchange.response, beast::bind_front_handler(&HttpSession::on_write, shared_from_this(), close));
+}
+
+void HttpSession::on_file_header(bool close, beast::error_code ec, std::size_t bytes_transferred)
+{
+    if (ec)
+        return on_write(close, ec, bytes_transferred);
+
+    send_file(close);
+}
+
+/**
+     * @brief Send the rest of the static file at the front of the pipeline. On Linux the kernel copies it from the
+     * page cache to the socket with sendfile, elsewhere it goes through the stream buffer in chunks.
+     */
+void HttpSession::send_file(bool close)
+{
+    auto &body = pipeline_.front()->file;
+    if (body.length == 0)
+        return on_write(close, {}, 0);
+
+#ifdef __linux__
+    auto &socket = stream_.socket();
+    beast::error_code ec;
+    socket.native_non_blocking(true, ec);
+    while (!ec && body.length != 0)
+    {
+        auto offset = static_cast<off_t>(body.offset);
+        auto count = std::min<std::uint64_t>(body.length, 0x7ffff000);
+        auto sent = ::sendfile(socket.native_handle(), body.file->fd, &offset, static_cast<std::size_t>(count));
+        if (sent > 0)
+        {
+            body.offset += static_cast<std::uint64_t>(sent);
+            body.length -= static_cast<std::uint64_t>(sent);
+        }
+        else if (sent == 0)
+        {
+            // The file shrank since it was opened
+            ec = net::error::eof;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            if (!fileTimer_)
+                fileTimer_.emplace(stream_.get_executor());
+            fileTimer_->expires_after(state_->httpOptions().writeTimeout);
+            fileTimer_->async_wait(
+                [self = shared_from_this()](beast::error_code timerEc)
+                {
+                    if (!timerEc)
+                        self->fail(beast::error::timeout, "send file");
+                });
+            return socket.async_wait(tcp::socket::wait_write,
+                                     [self = shared_from_this(), close](beast::error_code waitEc)
+                                     {
+                                         self->fileTimer_->cancel();
+                                         if (waitEc)
+                                             return self->on_write(close, waitEc, 0);
+                                         self->send_file(close);
+                                     });
+        }
+        else if (errno != EINTR)
+        {
+            ec.assign(errno, beast::system_category());
+        }
     }
+    on_write(close, ec, 0);
+#else
+    if (!streamBuffer_)
+        streamBuffer_ = std::make_unique<char[]>(HttpStream::ChunkSize);
 
-    handle_request(
-        state_->doc_root(),
-        parser_->release(),
-        [this](auto &&response) {
-            using response_type = typename std::decay<decltype(response)>::type;
-            auto sp = boost::make_shared<response_type>(std::forward<decltype(response)>(response));
+    auto count = static_cast<std::size_t>(std::min<std::uint64_t>(body.length, HttpStream::ChunkSize));
+    auto read = ::pread(body.file->fd, streamBuffer_.get(), count, static_cast<off_t>(body.offset));
+    if (read <= 0)
+        return on_write(close, read == 0 ? net::error::eof : beast::error_code(errno, beast::system_category()), 0);
 
-            auto self = shared_from_this();
-            http::async_write(stream_, *sp, [self, sp](beast::error_code ec, std::size_t bytes) {
-                self->on_write(ec, bytes, sp->need_eof());
-            });
-        },
-        router_);
+    body.offset += static_cast<std::uint64_t>(read);
+    body.length -= static_cast<std::uint64_t>(read);
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    net::async_write(stream_,
+                     net::buffer(streamBuffer_.get(), static_cast<std::size_t>(read)),
+                     [self = shared_from_this(), close](beast::error_code ec, std::size_t)
+                     {
+                         if (ec)
+                             return self->on_write(close, ec, 0);
+                         self->send_file(close);
+                     });
+#endif
 }
 
-void HttpSession::on_write(beast::error_code ec, std::size_t, bool close)
+void HttpSession::on_write(bool close, beast::error_code ec, std::size_t)
 {
+    writing_ = false;
+    auto exchange = std::move(pipeline_.front());
+    pipeline_.pop_front();
+    if (exchange->metrics != nullptr && exchange->response)
+        exchange->metrics->record(exchange->response->result_int(),
+                                  std::chrono::steady_clock::now() - exchange->started);
+    if (exchange->response && exchange->response->result_int() >= 500)
+        exchange->span.setError();
+    exchange->reset();
+    spare_.push_back(std::move(exchange));
+
     if (ec)
+    {
+        closed_ = true;
         return fail(ec, "write");
+    }
 
-    if (close)
+    if (close || (readDone_ && pipeline_.empty()))
     {
+        // Responses still waiting behind a closing one are dropped with the connection
+        closed_ = true;
         stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
         return;
     }
 
-    do_read();
+    do_write();
+
+    if (readPaused_)
+    {
+        readPaused_ = false;
+        do_read();
+    }
+}
+
+/**
+     * @brief Hand the connection over to a websocket session. Called once every earlier response has been written.
+     */
+void HttpSession::upgrade(Exchange &exchange)
+{
+    boost::make_shared<WebSocketSession>(stream_.release_socket(), state_, webSocketRouter_)
+        ->run(exchange.parser->release());
+    pipeline_.clear();
+}
+
+HttpSession::ShedStats HttpSession::shedStats() noexcept
+{
+    return {shedTimeouts.load(std::memory_order_relaxed), shedLimits.load(std::memory_order_relaxed)};
+}
+
+/**
+     * @brief Hand the request at the front of the pipeline to its streaming handler. The connection counts as
+     * writing until the handler ends the stream, so no other response can get in between.
+     */
+void HttpSession::start_stream(Exchange &exchange)
+{
+    exchange.streamParser.emplace(std::move(*exchange.parser));
+    const auto &req = exchange.streamParser->get();
+
+    RequestAllocator alloc(exchange.arena);
+    exchange.response.emplace(std::piecewise_construct, std::make_tuple(alloc), std::make_tuple(alloc));
+    exchange.response->version(req.version());
+    exchange.response->keep_alive(!readDone_);
+
+    if (!streamBuffer_)
+        streamBuffer_ = std::make_unique<char[]>(HttpStream::ChunkSize);
+
+    TraceScope traceScope(exchange.span.context());
+    exchange.route->streamHandler(HttpStream(shared_from_this(), req, *exchange.context));
+}
+
+void HttpSession::stream_read(HttpStream::ReadHandler handler)
+{
+    if (closed_)
+        return handler(net::error::operation_aborted, {});
+
+    auto &parser = *pipeline_.front()->streamParser;
+    if (parser.is_done())
+        return handler({}, {});
+
+    parser.get().body().data = streamBuffer_.get();
+    parser.get().body().size = HttpStream::ChunkSize;
+    stream_.expires_after(state_->httpOptions().bodyTimeout);
+    http::async_read_some(stream_,
+                          buffer_,
+                          parser,
+                          [self = shared_from_this(), handler = std::move(handler)](beast::error_code ec,
+                                                                                    std::size_t) mutable
+                          { self->on_stream_read(std::move(handler), ec); });
+}
+
+void HttpSession::on_stream_read(HttpStream::ReadHandler handler, beast::error_code ec)
+{
+    // The parser stops whenever the buffer is full, which is not an error
+    if (ec == http::error::need_buffer)
+        ec = {};
+
+    if (ec)
+    {
+        fail(ec, "read body");
+        closed_ = true;
+        return handler(ec, {});
+    }
+
+    auto &parser = *pipeline_.front()->streamParser;
+    auto size = HttpStream::ChunkSize - parser.get().body().size;
+    // Only framing was read, e.g. a chunk header, so an empty chunk would be mistaken for the end of the body
+    if (size == 0 && !parser.is_done())
+        return stream_read(std::move(handler));
+
+    handler({}, std::string_view(streamBuffer_.get(), size));
+}
+
+void HttpSession::stream_respond(http::status status, std::string_view contentType, std::string body)
+{
+    if (closed_)
+        return;
+
+    auto &exchange = *pipeline_.front();
+    auto &res = *exchange.response;
+    // A body that was not read to the end cannot be skipped to find the next request
+    if (!exchange.bodyDone())
+        readDone_ = true;
+
+    res.result(status);
+    res.set(http::field::content_type, beast::string_view(contentType.data(), contentType.size()));
+    res.body().assign(body.data(), body.size());
+    res.keep_alive(!readDone_);
+    res.prepare_payload();
+
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    auto close = res.need_eof();
+    http::async_write(stream_, res, beast::bind_front_handler(&HttpSession::on_write, shared_from_this(), close));
+}
+
+void HttpSession::stream_write_header(http::status status,
+                                      std::string_view contentType,
+                                      HttpStream::WriteHandler handler)
+{
+    if (closed_)
+        return handler(net::error::operation_aborted);
+
+    auto &exchange = *pipeline_.front();
+    auto &res = *exchange.response;
+    res.result(status);
+    res.set(http::field::content_type, beast::string_view(contentType.data(), contentType.size()));
+    res.chunked(true);
+    exchange.serializer.emplace(res);
+
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    http::async_write_header(stream_,
+                             *exchange.serializer,
+                             [self = shared_from_this(), handler = std::move(handler)](beast::error_code ec,
+                                                                                       std::size_t)
+                             { self->on_stream_write(handler, ec); });
+}
+
+void HttpSession::stream_write(std::string chunk, HttpStream::WriteHandler handler)
+{
+    if (closed_)
+        return handler(net::error::operation_aborted);
+
+    if (chunk.empty())
+        return handler({});
+
+    streamChunk_ = std::move(chunk);
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    net::async_write(stream_,
+                     http::make_chunk(net::buffer(streamChunk_)),
+                     [self = shared_from_this(), handler = std::move(handler)](beast::error_code ec, std::size_t)
+                     { self->on_stream_write(handler, ec); });
+}
+
+void HttpSession::on_stream_write(HttpStream::WriteHandler const &handler, beast::error_code ec)
+{
+    if (ec)
+    {
+        fail(ec, "write");
+        closed_ = true;
+    }
+    handler(ec);
+}
+
+void HttpSession::stream_finish(HttpStream::WriteHandler handler)
+{
+    if (closed_)
+    {
+        if (handler)
+            handler(net::error::operation_aborted);
+        return;
+    }
+
+    auto &exchange = *pipeline_.front();
+    // The header may already have promised keep-alive, but an unread body leaves the connection unusable
+    auto close = exchange.response->need_eof() || !exchange.bodyDone();
+    stream_.expires_after(state_->httpOptions().writeTimeout);
+    net::async_write(stream_,
+                     http::make_chunk_last(),
+                     [self = shared_from_this(), handler = std::move(handler), close](beast::error_code ec,
+                                                                                      std::size_t bytes)
+                     {
+                         // The handler may still look at the request, which goes away with the exchange
+                         if (handler)
+                             handler(ec);
+                         self->on_write(close, ec, bytes);
+                     });
 }
@@ -5,35 +5,127 @@
 #ifndef CCFOLIO_HTTPSESSION_H
 #define CCFOLIO_HTTPSESSION_H
 
+#include "Arena.h"
 #include "Beast.h"
+#include "HttpStream.h"
 #include "Net.h"
 #include "Router.h"
 #include "SharedState.h"
+#include "StaticFiles.h"
+#include "Tracing.h"
+#include "WebSocketRouter.h"
+#include <atomic>
+#include <boost/circular_buffer.hpp>
 #include <boost/optional.hpp>
 #include <boost/smart_ptr.hpp>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 class HttpSession : public boost::enable_shared_from_this<HttpSession>
 {
+    /// One request and its response. Each has its own arena, so pipelined requests can be released one by one.
+    struct Exchange
+    {
+        // Declared before the parser and response so it outlives everything allocated from it
+        MonotonicArena arena;
+        boost::optional<http::request_parser<http::string_body, RequestAllocator>> parser;
+        // Streaming routes take the parser over once the header is in and read the body in chunks
+        boost::optional<http::request_parser<http::buffer_body, RequestAllocator>> streamParser;
+        boost::optional<HttpResponse> response;
+        // Writes the header of a chunked response, whose chunks are then written one by one
+        boost::optional<http::response_serializer<HttpResponse::body_type, HttpResponse::fields_type>> serializer;
+        // Part of a static file sent after the header, set only for files too large to keep in memory
+        StaticFiles::Body file;
+        boost::optional<RequestContext> context;
+        // Matched once the header is in, so the route's body limit applies while the body is read
+        const Route *route = nullptr;
+        const RouteMetrics *metrics = nullptr;
+        std::chrono::steady_clock::time_point started;
+        // Covers the request from its header to its response, bodySpan the time spent reading the body
+        Span span;
+        Span bodySpan;
+        bool ready = false;
+        bool upgrade = false;
+        bool stream = false;
+
+        void reset() noexcept;
+        /// Whether the whole request body has been read
+        bool bodyDone() const noexcept;
+    };
+
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_;
     boost::shared_ptr<SharedState> state_;
     Router &router_;
+    WebSocketRouter const &webSocketRouter_;
 
-    boost::optional<http::request_parser<http::string_body>> parser_;
-
-    struct send_lambda;
+    // Requests in the order they were read, answered strictly from the front
+    boost::circular_buffer<std::unique_ptr<Exchange>> pipeline_;
+    // Finished exchanges kept with their warmed-up arenas
+    std::vector<std::unique_ptr<Exchange>> spare_;
+    std::unique_ptr<Exchange> reading_;
+    bool writing_ = false;
+    bool readPaused_ = false;
+    bool readDone_ = false;
+    bool closed_ = false;
+    std::size_t requestCount_ = 0;
+    // Streaming routes read the body into this buffer, allocated for the first one
+    std::unique_ptr<char[]> streamBuffer_;
+    std::string streamChunk_;
+    // Bounds each wait for the socket while sending a file, which tcp_stream's own timeout does not cover
+    boost::optional<net::steady_timer> fileTimer_;
 
     void fail(beast::error_code ec, char const *what);
     void do_read();
+    void on_idle(beast::error_code ec, std::size_t bytes_transferred);
+    void read_header();
+    void on_header(beast::error_code ec, std::size_t);
     void on_read(beast::error_code ec, std::size_t);
-    void on_write(beast::error_code ec, std::size_t, bool close);
+    bool enqueue();
+    void on_end_of_stream();
+    void do_write();
+    void on_write(bool close, beast::error_code ec, std::size_t);
+    void on_file_header(bool close, beast::error_code ec, std::size_t);
+    void send_file(bool close);
+    void upgrade(Exchange &exchange);
+
+    friend class HttpStream;
+    void start_stream(Exchange &exchange);
+    void stream_read(HttpStream::ReadHandler handler);
+    void on_stream_read(HttpStream::ReadHandler handler, beast::error_code ec);
+    void stream_respond(http::status status, std::string_view contentType, std::string body);
+    void stream_write_header(http::status status, std::string_view contentType, HttpStream::WriteHandler handler);
+    void stream_write(std::string chunk, HttpStream::WriteHandler handler);
+    void stream_finish(HttpStream::WriteHandler handler);
+    void on_stream_write(HttpStream::WriteHandler const &handler, beast::error_code ec);
 
 public:
-    HttpSession(tcp::socket &&socket, boost::shared_ptr<SharedState> const &state, Router &router);
+    /// Process wide counters of connections closed for running over a deadline or a size limit
+    struct ShedStats
+    {
+        std::uint64_t timeouts;
+        std::uint64_t limits;
+    };
+
+    HttpSession(tcp::socket &&socket,
+                boost::shared_ptr<SharedState> const &state,
+                Router &router,
+                WebSocketRouter const &webSocketRouter);
+
+    ~HttpSession();
 
     void run();
+
+    static ShedStats shedStats() noexcept;
+
+private:
+    static std::atomic<std::uint64_t> shedTimeouts;
+    static std::atomic<std::uint64_t> shedLimits;
 };
 
 #endif
@@ -0,0 +1,50 @@
+#include "HttpStream.h"
+#include "HttpSession.h"
+
+HttpStream::HttpStream(boost::shared_ptr<HttpSession> session,
+                       const HttpRequestHeader &request,
+                       const RequestContext &ctx)
+    : session_(std::move(session)), request_(&request), context_(&ctx)
+{
+}
+
+/**
+     * @brief Run a function on the connection's executor, inline if this thread is already on it.
+     */
+template <class Function>
+void HttpStream::onSession(Function &&function) const
+{
+    net::dispatch(session_->stream_.get_executor(),
+                  [session = session_, function = std::forward<Function>(function)]() mutable { function(*session); });
+}
+
+void HttpStream::read(ReadHandler handler) const
+{
+    onSession([handler = std::move(handler)](HttpSession &session) mutable
+              { session.stream_read(std::move(handler)); });
+}
+
+void HttpStream::respond(http::status status, std::string_view contentType, std::string body) const
+{
+    onSession([status, contentType = std::string(contentType), body = std::move(body)](HttpSession &session) mutable
+              { session.stream_respond(status, contentType, std::move(body)); });
+}
+
+void HttpStream::writeHeader(http::status status, std::string_view contentType, WriteHandler handler) const
+{
+    onSession(
+        [status, contentType = std::string(contentType), handler = std::move(handler)](HttpSession &session) mutable
+        { session.stream_write_header(status, contentType, std::move(handler)); });
+}
+
+void HttpStream::write(std::string chunk, WriteHandler handler) const
+{
+    onSession([chunk = std::move(chunk), handler = std::move(handler)](HttpSession &session) mutable
+              { session.stream_write(std::move(chunk), std::move(handler)); });
+}
+
+void HttpStream::finish(WriteHandler handler) const
+{
+    onSession([handler = std::move(handler)](HttpSession &session) mutable
+              { session.stream_finish(std::move(handler)); });
+}
@@ -0,0 +1,75 @@
+//
+// Created by fred on 5/2/24.
+//
+
+#ifndef CCFOLIO_HTTPSTREAM_H
+#define CCFOLIO_HTTPSTREAM_H
+
+#include "Beast.h"
+#include "Router.h"
+#include <boost/smart_ptr.hpp>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+class HttpSession;
+
+/**
+ * @brief The request of a streaming route, whose body is read and whose response is written piece by piece.
+ *
+ * The body is read in chunks of at most ChunkSize bytes into a buffer owned by the connection. The response is
+ * either sent whole with respond(), or started with writeHeader() and sent with chunked transfer encoding through
+ * write() and finish(). Neither side has to fit in memory, so large uploads and downloads cost a constant amount
+ * per connection.
+ *
+ * A stream may be copied and used from any thread, and its completion handlers run on the connection's executor.
+ * At most one read and one write may be in progress at a time. Every stream must end with respond() or finish(),
+ * after which it must no longer be used. If the body has not been read to the end by then, the connection is
+ * closed after the response.
+ */
+class HttpStream
+{
+public:
+    /// chunk is empty once the whole body has been read, and is only valid until the next read
+    using ReadHandler = std::function<void(beast::error_code ec, std::string_view chunk)>;
+    using WriteHandler = std::function<void(beast::error_code ec)>;
+
+    /// Largest chunk handed to a ReadHandler
+    static constexpr std::size_t ChunkSize = 16 * 1024;
+
+    HttpStream(boost::shared_ptr<HttpSession> session, const HttpRequestHeader &request, const RequestContext &ctx);
+
+    const HttpRequestHeader &request() const noexcept
+    {
+        return *request_;
+    }
+
+    const RequestContext &context() const noexcept
+    {
+        return *context_;
+    }
+
+    /// Read the next chunk of the body
+    void read(ReadHandler handler) const;
+
+    /// Send a complete response, e.g. to reject the request. Ends the stream.
+    void respond(http::status status, std::string_view contentType, std::string body) const;
+
+    /// Send the header of a chunked response
+    void writeHeader(http::status status, std::string_view contentType, WriteHandler handler) const;
+    /// Send one chunk of the response. Empty chunks are skipped, since they would end the body.
+    void write(std::string chunk, WriteHandler handler) const;
+    /// End the chunked response. Ends the stream.
+    void finish(WriteHandler handler = nullptr) const;
+
+private:
+    template <class Function>
+    void onSession(Function &&function) const;
+
+    boost::shared_ptr<HttpSession> session_;
+    const HttpRequestHeader *request_;
+    const RequestContext *context_;
+};
+
+#endif //CCFOLIO_HTTPSTREAM_H
@@ -8,24 +8,45 @@
 #include "Beast.h"
 #include "Net.h"
 #include "Router.h"
+#include "WebSocketRouter.h"
 #include <boost/smart_ptr.hpp>
 #include <memory>
 #include <string>
 
 class SharedState;
 
+/**
+ * @brief How a listener shares its io_context with other listeners.
+ */
+enum class ListenerMode
+{
+    /// One listener on an io_context run by several threads, every connection gets its own strand
+    Shared,
+    /// One listener per single-threaded io_context, all bound to the same port with SO_REUSEPORT.
+    /// The kernel spreads connections across the listeners and each connection stays on its thread.
+    PerThread
+};
+
 class Listener : public boost::enable_shared_from_this<Listener>
 {
     net::io_context &ioc_;
     tcp::acceptor acceptor_;
     boost::shared_ptr<SharedState> state_;
     Router &router_;
+    WebSocketRouter const &webSocketRouter_;
+    ListenerMode mode_;
 
     void fail(beast::error_code ec, char const *what);
+    void do_accept();
     void on_accept(beast::error_code ec, tcp::socket socket);
 
 public:
-    Listener(net::io_context &ioc, tcp::endpoint endpoint, boost::shared_ptr<SharedState> const &state, Router &router);
+    Listener(net::io_context &ioc,
+             tcp::endpoint endpoint,
+             boost::shared_ptr<SharedState> const &state,
+             Router &router,
+             WebSocketRouter const &webSocketRouter,
+             ListenerMode mode = ListenerMode::Shared);
 
     void run();
 };
@@ -0,0 +1,427 @@
+#include "Router.h"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+enum class ParamType
+{
+    Int,
+    String
+};
+
+bool isInteger(std::string_view value)
+{
+    if (!value.empty() && (value.front() == '-' || value.front() == '+'))
+        value.remove_prefix(1);
+
+    if (value.empty())
+        return false;
+
+    return std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+std::string_view toStd(boost::beast::string_view view)
+{
+    return {view.data(), view.size()};
+}
+} // namespace
+
+struct Router::Node
+{
+    ParamType paramType = ParamType::String;
+
+    /// Static prefix for static nodes, parameter name for parameter and wildcard nodes
+    std::string label;
+
+    /// Static children never share a first character
+    std::vector<std::unique_ptr<Node>> staticChildren;
+    /// Parameter children ordered by how strict they are, int before string
+    std::vector<std::unique_ptr<Node>> paramChildren;
+    std::unique_ptr<Node> wildcardChild;
+
+    std::optional<Route> route;
+};
+
+std::optional<std::string_view> RequestContext::param(std::string_view name) const noexcept
+{
+    for (std::size_t i = 0; i < paramCount_; ++i)
+    {
+        if (params_[i].name == name)
+            return params_[i].value;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::int64_t> RequestContext::intParam(std::string_view name) const noexcept
+{
+    auto value = param(name);
+    if (!value)
+        return std::nullopt;
+
+    auto text = *value;
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+
+    std::int64_t result{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+    if (ec != std::errc() || end != text.data() + text.size())
+        return std::nullopt;
+
+    return result;
+}
+
+Router::Router() = default;
+
+Router::~Router() = default;
+
+void Router::addRoute(std::string_view method, std::string_view path, Handler handler, RouteOptions options)
+{
+    addRoute(
+        method,
+        path,
+        [handler = std::move(handler)](const HttpRequest &req, HttpResponse &res, const RequestContext &) {
+            handler(req, res);
+        },
+        options);
+}
+
+void Router::addRoute(std::string_view method, std::string_view path, ContextHandler handler, RouteOptions options)
+{
+    insertRoute(method, path, Route{std::move(handler), nullptr, nullptr, options, {}});
+}
+
+void Router::addRoute(std::string_view method, std::string_view path, AsyncHandler handler, RouteOptions options)
+{
+    insertRoute(method, path, Route{nullptr, std::move(handler), nullptr, options, {}});
+}
+
+void Router::addRoute(std::string_view method, std::string_view path, StreamHandler handler, RouteOptions options)
+{
+    insertRoute(method, path, Route{nullptr, nullptr, std::move(handler), options, {}});
+}
+
+/**
+     * @brief Replace the body limit of a registered route, e.g. with one given on the command line.
+     *
+     * @param method The HTTP method the route was registered with, e.g. "POST"
+     * @param path The route pattern exactly as it was registered
+     * @param bodyLimit Largest request body accepted, 0 for the connection's default
+     * @throws std::logic_error if the router has been frozen
+     * @throws std::invalid_argument if no route has this method and pattern
+     */
+void Router::setBodyLimit(std::string_view method, std::string_view path, std::uint64_t bodyLimit)
+{
+    if (frozen_)
+        throw std::logic_error("Routes cannot be changed after the router has been frozen");
+
+    auto verb = http::string_to_verb(boost::beast::string_view(method.data(), method.size()));
+    auto name = std::string(method) + ' ' + std::string(path);
+    auto &root = trees_[static_cast<std::size_t>(verb)];
+    Route *route = verb == http::verb::unknown || !root ? nullptr : findRoute(*root, name);
+    if (route == nullptr)
+        throw std::invalid_argument("No route to set the body limit of: " + name);
+
+    route->options.bodyLimit = bodyLimit;
+}
+
+/**
+     * @brief Register a route for a method and route pattern.
+     *
+     * @param method The HTTP method, e.g. "GET"
+     * @param path The route pattern, see the Router documentation for the syntax
+     * @param route The handler to call when a request matches
+     * @throws std::logic_error if the router has been frozen
+     * @throws std::invalid_argument if the method or pattern is malformed or conflicts with an existing route
+     */
+void Router::insertRoute(std::string_view method, std::string_view path, Route route)
+{
+    if (frozen_)
+        throw std::logic_error("Routes cannot be added after the router has been frozen");
+
+    auto verb = http::string_to_verb(boost::beast::string_view(method.data(), method.size()));
+    if (verb == http::verb::unknown)
+        throw std::invalid_argument("Unknown HTTP method: " + std::string(method));
+
+    if (path.empty() || path.front() != '/')
+        throw std::invalid_argument("Route must start with '/': " + std::string(path));
+
+    route.metrics = RouteMetrics(method, path);
+
+    auto &root = trees_[static_cast<std::size_t>(verb)];
+    if (!root)
+        root = std::make_unique<Node>();
+
+    Node *node = root.get();
+    std::size_t paramCount = 0;
+    std::string_view rest = path;
+
+    while (!rest.empty())
+    {
+        auto open = rest.find('{');
+        node = insertStatic(node, rest.substr(0, open));
+        if (open == std::string_view::npos)
+            break;
+
+        auto close = rest.find('}', open);
+        if (close == std::string_view::npos || (open > 0 && rest[open - 1] != '/'))
+            throw std::invalid_argument("Malformed route parameter in: " + std::string(path));
+
+        auto spec = rest.substr(open + 1, close - open - 1);
+        rest.remove_prefix(close + 1);
+
+        if (!rest.empty() && rest.front() != '/')
+            throw std::invalid_argument("Route parameters must span a whole segment: " + std::string(path));
+
+        if (++paramCount > RequestContext::MaxParams)
+            throw std::invalid_argument("Too many parameters in route: " + std::string(path));
+
+        if (!spec.empty() && spec.front() == '*')
+        {
+            if (!rest.empty())
+                throw std::invalid_argument("Wildcard must be the last segment: " + std::string(path));
+
+            auto name = spec.substr(1);
+            if (!node->wildcardChild)
+            {
+                node->wildcardChild = std::make_unique<Node>();
+                node->wildcardChild->label = std::string(name);
+            }
+            else if (node->wildcardChild->label != name)
+            {
+                throw std::invalid_argument("Conflicting wildcard name in: " + std::string(path));
+            }
+            node = node->wildcardChild.get();
+            break;
+        }
+
+        auto colon = spec.find(':');
+        auto name = spec.substr(0, colon);
+        auto typeName = colon == std::string_view::npos ? std::string_view("string") : spec.substr(colon + 1);
+
+        ParamType type;
+        if (typeName == "int")
+            type = ParamType::Int;
+        else if (typeName == "string")
+            type = ParamType::String;
+        else
+            throw std::invalid_argument("Unknown parameter type '" + std::string(typeName) +
+                                        "' in: " + std::string(path));
+
+        if (name.empty())
+            throw std::invalid_argument("Unnamed route parameter in: " + std::string(path));
+
+        auto &children = node->paramChildren;
+        auto it =
+            std::find_if(children.begin(), children.end(), [type](const auto &c) { return c->paramType == type; });
+        if (it == children.end())
+        {
+            auto child = std::make_unique<Node>();
+            child->paramType = type;
+            child->label = std::string(name);
+            it = children.insert(std::upper_bound(children.begin(),
+                                                  children.end(),
+                                                  type,
+                                                  [](ParamType t, const auto &c) { return t < c->paramType; }),
+                                 std::move(child));
+        }
+        else if ((*it)->label != name)
+        {
+            throw std::invalid_argument("Conflicting parameter name '" + std::string(name) +
+                                        "' in: " + std::string(path));
+        }
+        node = it->get();
+    }
+
+    node->route = std::move(route);
+}
+
+/**
+     * @brief Find the route registered under a name, see RouteMetrics::name(). Only used while setting up.
+     */
+Route *Router::findRoute(Node &node, std::string_view name)
+{
+    if (node.route && node.route->metrics.name() == name)
+        return &*node.route;
+
+    for (auto &child : node.staticChildren)
+    {
+        if (auto *route = findRoute(*child, name))
+            return route;
+    }
+    for (auto &child : node.paramChildren)
+    {
+        if (auto *route = findRoute(*child, name))
+            return route;
+    }
+    return node.wildcardChild ? findRoute(*node.wildcardChild, name) : nullptr;
+}
+
+/**
+     * @brief Walk static text into the trie, splitting existing edges where they diverge.
+     *
+     * @return The node at which the text ends
+     */
+Router::Node *Router::insertStatic(Node *node, std::string_view text)
+{
+    while (!text.empty())
+    {
+        auto &children = node->staticChildren;
+        auto it = std::find_if(
+            children.begin(), children.end(), [&](const auto &c) { return c->label.front() == text.front(); });
+
+        if (it == children.end())
+        {
+            auto child = std::make_unique<Node>();
+            child->label = std::string(text);
+            children.push_back(std::move(child));
+            return children.back().get();
+        }
+
+        auto &child = *it;
+        auto diverge = std::mismatch(child->label.begin(), child->label.end(), text.begin(), text.end()).first;
+        auto common = static_cast<std::size_t>(diverge - child->label.begin());
+
+        if (common < child->label.size())
+        {
+            auto split = std::make_unique<Node>();
+            split->label = child->label.substr(0, common);
+            child->label.erase(0, common);
+            split->staticChildren.push_back(std::move(child));
+            child = std::move(split);
+        }
+
+        text.remove_prefix(common);
+        node = child.get();
+    }
+    return node;
+}
+
+bool Router::matchNode(const Node &node, std::string_view path, RequestContext &ctx, const Route *&out)
+{
+    if (path.empty() && node.route)
+    {
+        out = &*node.route;
+        return true;
+    }
+
+    if (!path.empty())
+    {
+        for (const auto &child : node.staticChildren)
+        {
+            if (child->label.front() != path.front())
+                continue;
+
+            if (path.compare(0, child->label.size(), child->label) == 0 &&
+                matchNode(*child, path.substr(child->label.size()), ctx, out))
+                return true;
+            break;
+        }
+
+        auto segment = path.substr(0, path.find('/'));
+        if (!segment.empty())
+        {
+            for (const auto &child : node.paramChildren)
+            {
+                if (child->paramType == ParamType::Int && !isInteger(segment))
+                    continue;
+
+                ctx.params_[ctx.paramCount_++] = {child->label, segment};
+                if (matchNode(*child, path.substr(segment.size()), ctx, out))
+                    return true;
+                --ctx.paramCount_;
+            }
+        }
+    }
+
+    if (node.wildcardChild && node.wildcardChild->route)
+    {
+        ctx.params_[ctx.paramCount_++] = {node.wildcardChild->label, path};
+        out = &*node.wildcardChild->route;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+     * @brief Find the route for a method and request target.
+     * The query string is stripped before matching and exposed through the context.
+     *
+     * @param method The request method
+     * @param target The raw request target
+     * @param ctx Receives the path, query and captured parameters
+     * @return The matched route, or nullptr if no route matches
+     */
+const Route *Router::match(http::verb method, std::string_view target, RequestContext &ctx) const
+{
+    auto index = static_cast<std::size_t>(method);
+    if (index >= trees_.size() || !trees_[index])
+        return nullptr;
+
+    auto queryStart = target.find('?');
+    ctx.path_ = target.substr(0, queryStart);
+    ctx.query_ = queryStart == std::string_view::npos ? std::string_view() : target.substr(queryStart + 1);
+    ctx.paramCount_ = 0;
+
+    const Route *route = nullptr;
+    if (!matchNode(*trees_[index], ctx.path_, ctx, route))
+        return nullptr;
+    return route;
+}
+
+/**
+     * @brief Route a request to its handler.
+     * Synchronous handlers run inline and done is called before this returns.
+     * Asynchronous handlers call done themselves once the response is ready.
+     *
+     * @param req The request
+     * @param res The response to fill in
+     * @param ctx Context for the request, must stay valid until done is called
+     * @param done Called once the response is ready
+     * @return false if no route matches or the route is a streaming one, in which case done is not called
+     */
+bool Router::dispatch(const HttpRequest &req, HttpResponse &res, RequestContext &ctx, CompletionHandler done) const
+{
+    auto route = match(req.method(), toStd(req.target()), ctx);
+    if (route == nullptr || route->isStreaming())
+        return false;
+
+    invoke(*route, req, res, ctx, std::move(done));
+    return true;
+}
+
+/**
+     * @brief Run the handler of a route that has already been matched, e.g. before the request body was read.
+     * Synchronous handlers call done before this returns. Streaming routes are run by the session instead.
+     */
+void Router::invoke(
+    const Route &route, const HttpRequest &req, HttpResponse &res, const RequestContext &ctx, CompletionHandler done)
+{
+    if (route.isAsync())
+    {
+        route.asyncHandler(req, res, ctx, std::move(done));
+        return;
+    }
+
+    route.handler(req, res, ctx);
+    done();
+}
+
+/**
+     * @brief Route a request to a synchronous handler.
+     *
+     * @return false if no synchronous route matches
+     */
+bool Router::handleRequest(const HttpRequest &req, HttpResponse &res) const
+{
+    RequestContext ctx;
+    auto route = match(req.method(), toStd(req.target()), ctx);
+    if (route == nullptr || route->isAsync() || route->isStreaming())
+        return false;
+
+    route->handler(req, res, ctx);
+    return true;
+}
@@ -5,39 +5,200 @@
 #ifndef CCFOLIO_ROUTER_H
 #define CCFOLIO_ROUTER_H
 
+#include "Arena.h"
+#include "HttpMetrics.h"
+#include "Net.h"
+#include <array>
 #include <boost/beast/http.hpp>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 namespace http = boost::beast::http;
 
-using HttpRequest = http::request<http::string_body>;
-using HttpResponse = http::response<http::string_body>;
-using Handler = std::function<void(const HttpRequest &, HttpResponse &)>;
+/// Request with header fields drawn from Allocator. The body stays a std::string so handlers can parse it directly.
+template <class Allocator>
+using BasicHttpRequest = http::request<http::string_body, http::basic_fields<Allocator>>;
 
-class Router
+/// Response with header fields and body drawn from Allocator
+template <class Allocator>
+using BasicHttpResponse =
+    http::response<http::basic_string_body<char, std::char_traits<char>, Allocator>, http::basic_fields<Allocator>>;
+
+/// Requests and responses live in the owning connection's arena and are released together after each write
+using RequestAllocator = ArenaAllocator<char>;
+using HttpRequest = BasicHttpRequest<RequestAllocator>;
+using HttpResponse = BasicHttpResponse<RequestAllocator>;
+/// Header of a request whose body is streamed instead of buffered
+using HttpRequestHeader = http::request_header<http::basic_fields<RequestAllocator>>;
+
+class HttpStream;
+
+/**
+ * @brief Routing information for a matched request.
+ * Parameter names point into the router's route table and values point into the request target,
+ * so a context must not outlive the request it was matched against.
+ */
+class RequestContext
 {
+public:
+    static constexpr std::size_t MaxParams = 8;
+
+    RequestContext() = default;
+
+    explicit RequestContext(net::any_io_executor executor) : executor_(std::move(executor))
+    {
+    }
+
+    /// Executor of the connection the request arrived on. Asynchronous handlers can resume their work on it.
+    const net::any_io_executor &executor() const noexcept
+    {
+        return executor_;
+    }
+
+    std::string_view path() const noexcept
+    {
+        return path_;
+    }
+
+    std::string_view query() const noexcept
+    {
+        return query_;
+    }
+
+    std::size_t paramCount() const noexcept
+    {
+        return paramCount_;
+    }
+
+    std::optional<std::string_view> param(std::string_view name) const noexcept;
+    std::optional<std::int64_t> intParam(std::string_view name) const noexcept;
+
 private:
-    std::unordered_map<std::string, Handler> routes;
+    friend class Router;
+
+    struct Param
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    net::any_io_executor executor_;
+    std::string_view path_;
+    std::string_view query_;
+    std::array<Param, MaxParams> params_{};
+    std::size_t paramCount_ = 0;
+};
 
+using Handler = std::function<void(const HttpRequest &, HttpResponse &)>;
+using ContextHandler = std::function<void(const HttpRequest &, HttpResponse &, const RequestContext &)>;
+
+/// Signals that an asynchronous handler has filled in the response. Must be called exactly once, from any thread.
+using CompletionHandler = std::function<void()>;
+
+/**
+ * @brief Handler that may finish after it returns.
+ * The request, response and context stay valid until the completion handler is called.
+ */
+using AsyncHandler =
+    std::function<void(const HttpRequest &, HttpResponse &, const RequestContext &, CompletionHandler)>;
+
+/**
+ * @brief Handler that reads the request body and writes the response piece by piece, see HttpStream.
+ * It is called once the request header is in and every earlier response on the connection has been written.
+ */
+using StreamHandler = std::function<void(const HttpStream &stream)>;
+
+/// Limits for one route that override the connection's defaults
+struct RouteOptions
+{
+    /// Largest request body accepted, 0 for the connection's default
+    std::uint64_t bodyLimit = 0;
+};
+
+/// A registered route, either synchronous, asynchronous or streaming
+struct Route
+{
+    ContextHandler handler;
+    AsyncHandler asyncHandler;
+    StreamHandler streamHandler;
+    RouteOptions options;
+    RouteMetrics metrics;
+
+    bool isAsync() const noexcept
+    {
+        return static_cast<bool>(asyncHandler);
+    }
+
+    bool isStreaming() const noexcept
+    {
+        return static_cast<bool>(streamHandler);
+    }
+};
+
+/**
+ * @brief HTTP router backed by one compressed radix trie per method.
+ *
+ * Route patterns are literal paths with optional parameter segments:
+ *  - "{name}" or "{name:string}" matches one non-empty path segment
+ *  - "{name:int}" matches one segment of decimal digits, optionally signed
+ *  - "{*name}" matches the rest of the path and must be the last segment
+ *
+ * Static segments take precedence over parameters, and parameters over wildcards.
+ * Routes are registered during startup and the router is then frozen, after which
+ * lookups walk an immutable trie and need neither locks nor heap allocations.
+ */
+class Router
+{
 public:
-    void addRoute(std::string method, std::string path, Handler handler)
+    Router();
+    ~Router();
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    void addRoute(std::string_view method, std::string_view path, Handler handler, RouteOptions options = {});
+    void addRoute(std::string_view method,
+                  std::string_view path,
+                  ContextHandler handler,
+                  RouteOptions options = {});
+    void addRoute(std::string_view method, std::string_view path, AsyncHandler handler, RouteOptions options = {});
+    void addRoute(std::string_view method, std::string_view path, StreamHandler handler, RouteOptions options = {});
+    void setBodyLimit(std::string_view method, std::string_view path, std::uint64_t bodyLimit);
+
+    void freeze() noexcept
     {
-        routes[method + ":" + path] = handler;
+        frozen_ = true;
     }
 
-    bool handleRequest(const HttpRequest &req, HttpResponse &res)
+    bool isFrozen() const noexcept
     {
-        std::string key = req.method_string().to_string() + ":" + std::string(req.target());
-        auto it = routes.find(key);
-        if (it != routes.end())
-        {
-            it->second(req, res);
-            return true;
-        }
-        return false;
+        return frozen_;
     }
+
+    const Route *match(http::verb method, std::string_view target, RequestContext &ctx) const;
+    bool dispatch(const HttpRequest &req, HttpResponse &res, RequestContext &ctx, CompletionHandler done) const;
+    static void invoke(const Route &route,
+                       const HttpRequest &req,
+                       HttpResponse &res,
+                       const RequestContext &ctx,
+                       CompletionHandler done);
+    bool handleRequest(const HttpRequest &req, HttpResponse &res) const;
+
+private:
+    struct Node;
+
+    static constexpr std::size_t VerbCount = static_cast<std::size_t>(http::verb::unlink) + 1;
+
+    void insertRoute(std::string_view method, std::string_view path, Route route);
+    static Node *insertStatic(Node *node, std::string_view text);
+    static Route *findRoute(Node &node, std::string_view name);
+    static bool matchNode(const Node &node, std::string_view path, RequestContext &ctx, const Route *&out);
+
+    std::array<std::unique_ptr<Node>, VerbCount> trees_;
+    bool frozen_ = false;
 };
 
 #endif //CCFOLIO_ROUTER_H
@@ -0,0 +1,88 @@
+#include "SendQueue.h"
+#include <algorithm>
+
+std::atomic<std::uint64_t> SendQueue::totalDropped{0};
+std::atomic<std::uint64_t> SendQueue::totalCoalesced{0};
+std::atomic<std::uint64_t> SendQueue::totalDisconnects{0};
+std::atomic<std::uint64_t> SendQueue::totalQueuedBytes{0};
+
+SendQueue::SendQueue(SendQueueOptions const &options)
+    : options_(options), messages_(std::max<std::size_t>(1, options.maxMessages))
+{
+}
+
+SendQueue::~SendQueue()
+{
+    totalQueuedBytes.fetch_sub(queuedBytes_, std::memory_order_relaxed);
+}
+
+/**
+     * @brief Queue a message. The policy only applies when other messages are waiting, so a single message
+     * larger than the high watermark is still sent.
+     *
+     * @param message The message to queue
+     * @return false if the policy is Disconnect and the session should be closed
+     */
+bool SendQueue::push(Message message)
+{
+    auto size = message->size();
+    if (!messages_.empty() && (messages_.full() || queuedBytes_ + size > options_.highWatermarkBytes))
+    {
+        switch (options_.policy)
+        {
+        case SlowConsumerPolicy::Disconnect:
+            totalDisconnects.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        case SlowConsumerPolicy::Coalesce:
+            totalCoalesced.fetch_add(messages_.size(), std::memory_order_relaxed);
+            totalQueuedBytes.fetch_sub(queuedBytes_, std::memory_order_relaxed);
+            messages_.clear();
+            queuedBytes_ = 0;
+            break;
+        case SlowConsumerPolicy::DropOldest:
+            // Trim to the low watermark rather than the high one, so a slow client does not pay on every message
+            while (!messages_.empty() && (messages_.full() || queuedBytes_ + size > options_.lowWatermarkBytes))
+                dropFront();
+            break;
+        }
+    }
+
+    queuedBytes_ += size;
+    totalQueuedBytes.fetch_add(size, std::memory_order_relaxed);
+    messages_.push_back(std::move(message));
+    updateCounters();
+    return true;
+}
+
+/**
+     * @brief Take the oldest waiting message. The queue must not be empty.
+     */
+SendQueue::Message SendQueue::pop()
+{
+    auto message = std::move(messages_.front());
+    messages_.pop_front();
+    queuedBytes_ -= message->size();
+    totalQueuedBytes.fetch_sub(message->size(), std::memory_order_relaxed);
+    updateCounters();
+    return message;
+}
+
+void SendQueue::dropFront()
+{
+    pop();
+    totalDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SendQueue::updateCounters() noexcept
+{
+    depth_.store(messages_.size(), std::memory_order_relaxed);
+    bytes_.store(queuedBytes_, std::memory_order_relaxed);
+}
+
+SendQueue::Stats SendQueue::globalStats() noexcept
+{
+    return {totalDropped.load(std::memory_order_relaxed),
+            totalCoalesced.load(std::memory_order_relaxed),
+            totalDisconnects.load(std::memory_order_relaxed),
+            totalQueuedBytes.load(std::memory_order_relaxed)};
+}
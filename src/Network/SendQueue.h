@@ -0,0 +1,109 @@
+//
+// Created by fred on 4/27/24.
+//
+
+#ifndef CCFOLIO_SENDQUEUE_H
+#define CCFOLIO_SENDQUEUE_H
+
+#include <atomic>
+#include <boost/circular_buffer.hpp>
+#include <boost/smart_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief What a session does when a client reads slower than messages arrive for it.
+ */
+enum class SlowConsumerPolicy
+{
+    /// Drop the oldest waiting messages until the queue is back under the low watermark
+    DropOldest,
+    /// Replace every waiting message with the newest one, for streams where a message supersedes the previous
+    Coalesce,
+    /// Close the connection
+    Disconnect
+};
+
+struct SendQueueOptions
+{
+    /// Messages that may wait behind the one being written
+    std::size_t maxMessages = 1024;
+    /// Waiting bytes at which the policy kicks in
+    std::size_t highWatermarkBytes = 4 * 1024 * 1024;
+    /// Waiting bytes DropOldest trims the queue down to
+    std::size_t lowWatermarkBytes = 1024 * 1024;
+    SlowConsumerPolicy policy = SlowConsumerPolicy::DropOldest;
+};
+
+/**
+ * @brief Bounded queue of outbound websocket messages for one session.
+ *
+ * Messages wait in a fixed-capacity ring, so removing the front is O(1) and the queue never grows past
+ * maxMessages. The message being written is held by the session, not the queue, and is never dropped.
+ * A queue is not thread safe and must only be used on its session's executor; depth() and bytes() may be
+ * read from anywhere.
+ */
+class SendQueue
+{
+public:
+    using Message = boost::shared_ptr<std::string const>;
+
+    /// Process wide counters
+    struct Stats
+    {
+        std::uint64_t dropped;
+        std::uint64_t coalesced;
+        std::uint64_t disconnects;
+        std::uint64_t queuedBytes;
+    };
+
+    explicit SendQueue(SendQueueOptions const &options);
+    ~SendQueue();
+    SendQueue(const SendQueue &) = delete;
+    SendQueue &operator=(const SendQueue &) = delete;
+
+    /**
+     * @brief Queue a message, applying the slow consumer policy if the queue is over its limits.
+     *
+     * @return false if the policy is Disconnect and the session should be closed
+     */
+    bool push(Message message);
+    Message pop();
+
+    bool empty() const noexcept
+    {
+        return messages_.empty();
+    }
+
+    /// Number of waiting messages
+    std::size_t depth() const noexcept
+    {
+        return depth_.load(std::memory_order_relaxed);
+    }
+
+    /// Bytes of waiting messages
+    std::size_t bytes() const noexcept
+    {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+    static Stats globalStats() noexcept;
+
+private:
+    void dropFront();
+    void updateCounters() noexcept;
+
+    SendQueueOptions options_;
+    boost::circular_buffer<Message> messages_;
+    std::size_t queuedBytes_ = 0;
+    std::atomic<std::size_t> depth_{0};
+    std::atomic<std::size_t> bytes_{0};
+
+    static std::atomic<std::uint64_t> totalDropped;
+    static std::atomic<std::uint64_t> totalCoalesced;
+    static std::atomic<std::uint64_t> totalDisconnects;
+    static std::atomic<std::uint64_t> totalQueuedBytes;
+};
+
+#endif //CCFOLIO_SENDQUEUE_H
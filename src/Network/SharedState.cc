@@ -1,35 +1,42 @@
 #include "SharedState.h"
 #include "WebSocketSession.h"
 
-SharedState::SharedState(std::string doc_root) : doc_root_(std::move(doc_root))
+SharedState::SharedState(std::string doc_root,
+                         SendQueueOptions sendQueueOptions,
+                         DeflateOptions deflateOptions,
+                         HttpOptions httpOptions,
+                         StaticFileOptions staticFileOptions)
+    : doc_root_(std::move(doc_root)), sendQueueOptions_(sendQueueOptions), deflateOptions_(deflateOptions),
+      httpOptions_(httpOptions), staticFiles_(doc_root_, staticFileOptions)
 {
 }
 
 void SharedState::join(WebSocketSession *session)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    sessions_.insert(session);
+    sessions_.join(*session);
 }
 
 void SharedState::leave(WebSocketSession *session)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    sessions_.erase(session);
+    sessions_.leave(*session);
 }
 
 void SharedState::send(std::string message)
 {
-    auto const ss = boost::make_shared<std::string const>(std::move(message));
+    sessions_.broadcast(boost::make_shared<std::string const>(std::move(message)));
+}
 
-    std::vector<boost::weak_ptr<WebSocketSession>> v;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        v.reserve(sessions_.size());
-        for (auto p : sessions_)
-            v.emplace_back(p->weak_from_this());
-    }
+void SharedState::subscribe(std::string_view topic, WebSocketSession &session)
+{
+    topics_.subscribe(topic, session);
+}
 
-    for (auto const &wp : v)
-        if (auto sp = wp.lock())
-            sp->send(ss);
+void SharedState::unsubscribe(std::string_view topic, WebSocketSession &session)
+{
+    topics_.unsubscribe(topic, session);
+}
+
+std::size_t SharedState::publish(std::string_view topic, std::string message)
+{
+    return topics_.publish(topic, boost::make_shared<std::string const>(std::move(message)));
 }
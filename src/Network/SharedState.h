@@ -6,31 +6,124 @@
 #define CCFOLIO_SHAREDSTATE_H
 
 //#include "ChatRoom.h"
+#include "BroadcastGroup.h"
+#include "DeflateOptions.h"
+#include "HttpOptions.h"
+#include "SendQueue.h"
+#include "StaticFiles.h"
+#include "TopicRegistry.h"
+#include <atomic>
 #include <boost/smart_ptr.hpp>
 #include <memory>
-#include <mutex>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <vector>
 
 class WebSocketSession;
 
 class SharedState
 {
     std::string const doc_root_;
-    std::mutex mutex_;
-    std::unordered_set<WebSocketSession *> sessions_;
+    SendQueueOptions const sendQueueOptions_;
+    DeflateOptions const deflateOptions_;
+    HttpOptions const httpOptions_;
+    StaticFiles const staticFiles_;
+    BroadcastGroup sessions_;
+    TopicRegistry topics_;
+    std::atomic<std::size_t> deflateSessions_{0};
 
 public:
-    explicit SharedState(std::string doc_root);
+    explicit SharedState(std::string doc_root,
+                         SendQueueOptions sendQueueOptions = {},
+                         DeflateOptions deflateOptions = {},
+                         HttpOptions httpOptions = {},
+                         StaticFileOptions staticFileOptions = {});
 
     std::string const &doc_root() const noexcept
     {
         return doc_root_;
     }
 
+    /// Limits for the outbound queue of every websocket session
+    SendQueueOptions const &sendQueueOptions() const noexcept
+    {
+        return sendQueueOptions_;
+    }
+
+    /// Settings for every HTTP connection
+    HttpOptions const &httpOptions() const noexcept
+    {
+        return httpOptions_;
+    }
+
+    /// Files served from doc_root for GET and HEAD requests that match no route
+    StaticFiles const &staticFiles() const noexcept
+    {
+        return staticFiles_;
+    }
+
+    /// permessage-deflate settings offered to every websocket client
+    DeflateOptions const &deflateOptions() const noexcept
+    {
+        return deflateOptions_;
+    }
+
     void join(WebSocketSession *session);
     void leave(WebSocketSession *session);
+    /// Send a message to every session
     void send(std::string message);
+
+    void subscribe(std::string_view topic, WebSocketSession &session);
+    void unsubscribe(std::string_view topic, WebSocketSession &session);
+    /// Send a message to the subscribers of a topic. @return The number of subscribers
+    std::size_t publish(std::string_view topic, std::string message);
+
+    std::vector<TopicRegistry::TopicStats> topicStats() const
+    {
+        return topics_.stats();
+    }
+
+    std::vector<TopicRegistry::TopicStats> busiestTopics(std::size_t limit) const
+    {
+        return topics_.busiestTopics(limit);
+    }
+
+    TopicRegistry::Totals topicTotals() const
+    {
+        return topics_.totals();
+    }
+
+    std::size_t topicCount() const
+    {
+        return topics_.topicCount();
+    }
+
+    std::size_t sessionCount() const
+    {
+        return sessions_.size();
+    }
+
+    void deflateSessionOpened() noexcept
+    {
+        deflateSessions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void deflateSessionClosed() noexcept
+    {
+        deflateSessions_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// Open sessions that negotiated permessage-deflate
+    std::size_t deflateSessionCount() const noexcept
+    {
+        return deflateSessions_.load(std::memory_order_relaxed);
+    }
+
+    /// Estimated zlib memory held by all open sessions that negotiated permessage-deflate
+    std::size_t deflateMemoryBytes() const noexcept
+    {
+        return deflateSessionCount() * deflateOptions_.memoryPerSession();
+    }
 };
 
 #endif
@@ -0,0 +1,326 @@
+#include "StaticFiles.h"
+#include <charconv>
+#include <ctime>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+std::string_view toStd(boost::beast::string_view view)
+{
+    return {view.data(), view.size()};
+}
+
+/// From the Beast examples, extended with the types front-end builds produce
+std::string_view mimeType(std::string_view path)
+{
+    auto dot = path.rfind('.');
+    auto ext = dot == std::string_view::npos ? std::string_view() : path.substr(dot);
+    auto is = [ext](boost::beast::string_view candidate)
+    { return boost::beast::iequals(boost::beast::string_view(ext.data(), ext.size()), candidate); };
+
+    if (is(".htm") || is(".html"))
+        return "text/html; charset=utf-8";
+    if (is(".css"))
+        return "text/css; charset=utf-8";
+    if (is(".txt"))
+        return "text/plain; charset=utf-8";
+    if (is(".js") || is(".mjs"))
+        return "application/javascript; charset=utf-8";
+    if (is(".json") || is(".map"))
+        return "application/json";
+    if (is(".xml"))
+        return "application/xml";
+    if (is(".wasm"))
+        return "application/wasm";
+    if (is(".png"))
+        return "image/png";
+    if (is(".jpe") || is(".jpeg") || is(".jpg"))
+        return "image/jpeg";
+    if (is(".gif"))
+        return "image/gif";
+    if (is(".webp"))
+        return "image/webp";
+    if (is(".ico"))
+        return "image/vnd.microsoft.icon";
+    if (is(".svg") || is(".svgz"))
+        return "image/svg+xml";
+    if (is(".woff"))
+        return "font/woff";
+    if (is(".woff2"))
+        return "font/woff2";
+    return "application/octet-stream";
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Turn a request target into a path below the document root.
+ *
+ * @return The percent-decoded path, or an empty string if it could escape the document root
+ */
+std::string resolvePath(std::string_view target)
+{
+    target = target.substr(0, target.find_first_of("?#"));
+    if (target.empty() || target.front() != '/')
+        return {};
+
+    std::string path;
+    path.reserve(target.size() + 10);
+    for (std::size_t i = 0; i < target.size(); ++i)
+    {
+        auto c = target[i];
+        if (c == '%')
+        {
+            if (i + 2 >= target.size() || hexValue(target[i + 1]) < 0 || hexValue(target[i + 2]) < 0)
+                return {};
+            c = static_cast<char>(hexValue(target[i + 1]) * 16 + hexValue(target[i + 2]));
+            i += 2;
+        }
+        if (c == '\0' || c == '\\')
+            return {};
+        path.push_back(c);
+    }
+
+    // Any ".." segment could climb out of the document root, and no legitimate asset needs one
+    for (std::size_t start = 0; start < path.size();)
+    {
+        auto end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (path.compare(start, end - start, "..") == 0)
+            return {};
+        start = end + 1;
+    }
+
+    if (path.back() == '/')
+        path += "index.html";
+    return path;
+}
+
+std::string httpDate(std::time_t time)
+{
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[32];
+    auto size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buffer, size);
+}
+
+/// Whether an If-None-Match list contains the tag, compared weakly as RFC 9110 requires
+bool etagMatches(std::string_view header, std::string_view etag)
+{
+    while (!header.empty())
+    {
+        auto comma = header.find(',');
+        auto item = header.substr(0, comma);
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+        while (!item.empty() && item.front() == ' ')
+            item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ')
+            item.remove_suffix(1);
+        if (item.substr(0, 2) == "W/")
+            item.remove_prefix(2);
+
+        if (item == "*" || item == etag)
+            return true;
+    }
+    return false;
+}
+
+enum class RangeResult
+{
+    None,
+    Satisfiable,
+    Unsatisfiable
+};
+
+/**
+ * @brief Parse a Range header for a single byte range. Anything else is treated as no range at all.
+ */
+RangeResult parseRange(std::string_view header, std::uint64_t size, std::uint64_t &offset, std::uint64_t &length)
+{
+    constexpr std::string_view prefix = "bytes=";
+    if (header.substr(0, prefix.size()) != prefix)
+        return RangeResult::None;
+    header.remove_prefix(prefix.size());
+
+    auto dash = header.find('-');
+    if (dash == std::string_view::npos || header.find(',') != std::string_view::npos)
+        return RangeResult::None;
+
+    auto parse = [](std::string_view text, std::uint64_t &value)
+    {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && end == text.data() + text.size();
+    };
+
+    auto first = header.substr(0, dash);
+    auto last = header.substr(dash + 1);
+    std::uint64_t start = 0;
+    std::uint64_t end = 0;
+
+    if (first.empty())
+    {
+        // A suffix range, the last n bytes
+        if (!parse(last, end) || end == 0)
+            return last.empty() ? RangeResult::None : RangeResult::Unsatisfiable;
+        if (size == 0)
+            return RangeResult::Unsatisfiable;
+        offset = size - std::min(end, size);
+        length = size - offset;
+        return RangeResult::Satisfiable;
+    }
+
+    if (!parse(first, start) || (!last.empty() && (!parse(last, end) || end < start)))
+        return RangeResult::None;
+    if (start >= size)
+        return RangeResult::Unsatisfiable;
+
+    offset = start;
+    length = (last.empty() ? size - 1 : std::min(end, size - 1)) - start + 1;
+    return RangeResult::Satisfiable;
+}
+} // namespace
+
+StaticFile::~StaticFile()
+{
+    if (fd != -1)
+        ::close(fd);
+}
+
+StaticFiles::StaticFiles(std::string docRoot, StaticFileOptions options)
+    : docRoot_(std::move(docRoot)), options_(options), cache_(std::max<std::size_t>(1, options.cacheEntries))
+{
+    while (!docRoot_.empty() && docRoot_.back() == '/')
+        docRoot_.pop_back();
+}
+
+/**
+     * @brief Open a file and read its metadata, and its contents if it is small.
+     *
+     * @param path Path below the document root, starting with '/'
+     * @return The file, or nullptr if it does not exist or is not a regular file
+     */
+std::shared_ptr<const StaticFile> StaticFiles::open(const std::string &path) const
+{
+    auto file = std::make_shared<StaticFile>();
+    file->fd = ::open((docRoot_ + path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd == -1)
+        return nullptr;
+
+    struct stat info{};
+    if (::fstat(file->fd, &info) != 0 || !S_ISREG(info.st_mode))
+        return nullptr;
+
+    file->size = static_cast<std::uint64_t>(info.st_size);
+#ifdef __APPLE__
+    auto modifiedNs = static_cast<std::uint64_t>(info.st_mtimespec.tv_sec) * 1000000000u +
+                      static_cast<std::uint64_t>(info.st_mtimespec.tv_nsec);
+#else
+    auto modifiedNs = static_cast<std::uint64_t>(info.st_mtim.tv_sec) * 1000000000u +
+                      static_cast<std::uint64_t>(info.st_mtim.tv_nsec);
+#endif
+    file->etag = fmt::format("\"{:x}-{:x}\"", file->size, modifiedNs);
+    file->lastModified = httpDate(info.st_mtime);
+    file->contentType = mimeType(path);
+
+    if (file->size <= options_.smallFileBytes)
+    {
+        file->contents.resize(file->size);
+        std::size_t done = 0;
+        while (done < file->contents.size())
+        {
+            auto n = ::pread(
+                file->fd, file->contents.data() + done, file->contents.size() - done, static_cast<off_t>(done));
+            if (n <= 0)
+                return nullptr;
+            done += static_cast<std::size_t>(n);
+        }
+        ::close(file->fd);
+        file->fd = -1;
+    }
+    return file;
+}
+
+bool StaticFiles::serve(const HttpRequest &req, HttpResponse &res, Body &body) const
+{
+    auto path = resolvePath(toStd(req.target()));
+    if (path.empty())
+        return false;
+
+    // Entries expire after revalidateAfter, so a changed file is picked up by the next request after that
+    std::shared_ptr<const StaticFile> file;
+    if (auto cached = cache_.get(path))
+    {
+        file = std::move(*cached);
+    }
+    else
+    {
+        file = open(path);
+        if (!file)
+            return false;
+        cache_.put(path, file, options_.revalidateAfter);
+    }
+
+    res.set(http::field::etag, file->etag);
+    res.set(http::field::last_modified, file->lastModified);
+    res.set(http::field::accept_ranges, "bytes");
+
+    if (auto match = req.find(http::field::if_none_match);
+        match != req.end() && etagMatches(toStd(match->value()), file->etag))
+    {
+        res.result(http::status::not_modified);
+        return true;
+    }
+
+    res.result(http::status::ok);
+    std::uint64_t offset = 0;
+    std::uint64_t length = file->size;
+    auto range = req.find(http::field::range);
+    auto ifRange = req.find(http::field::if_range);
+    if (range != req.end() && (ifRange == req.end() || toStd(ifRange->value()) == file->etag))
+    {
+        switch (parseRange(toStd(range->value()), file->size, offset, length))
+        {
+        case RangeResult::Unsatisfiable:
+            res.result(http::status::range_not_satisfiable);
+            res.set(http::field::content_range, fmt::format("bytes */{}", file->size));
+            res.content_length(0);
+            return true;
+        case RangeResult::Satisfiable:
+            res.result(http::status::partial_content);
+            res.set(http::field::content_range,
+                    fmt::format("bytes {}-{}/{}", offset, offset + length - 1, file->size));
+            break;
+        case RangeResult::None:
+            offset = 0;
+            length = file->size;
+            break;
+        }
+    }
+
+    res.set(http::field::content_type, boost::beast::string_view(file->contentType.data(), file->contentType.size()));
+    res.content_length(length);
+    if (req.method() != http::verb::get || length == 0)
+        return true;
+
+    // Small files go out with the header in one write, larger ones are sent from the descriptor after it
+    if (file->inMemory())
+        res.body().assign(file->contents.data() + offset, length);
+    else
+        body = Body{std::move(file), offset, length};
+    return true;
+}
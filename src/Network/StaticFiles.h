@@ -0,0 +1,104 @@
+//
+// Created by fred on 5/3/24.
+//
+
+#ifndef CCFOLIO_STATICFILES_H
+#define CCFOLIO_STATICFILES_H
+
+#include "Router.h"
+#include "ShardedLruCache.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+struct StaticFileOptions
+{
+    bool enabled = true;
+    /// Files kept open between requests. Each holds a file descriptor, or its contents if it is small.
+    std::size_t cacheEntries = 256;
+    /// Files up to this size are read into memory once and served from there
+    std::size_t smallFileBytes = 64 * 1024;
+    /// How long a cached file is served before the file system is checked for a newer version
+    std::chrono::seconds revalidateAfter{2};
+};
+
+/**
+ * @brief An open file under the document root, shared by the cache and the responses that are sending it.
+ * The descriptor is closed once the last of them lets go, so evicting a file never cuts a response short.
+ */
+struct StaticFile
+{
+    StaticFile() = default;
+    ~StaticFile();
+    StaticFile(const StaticFile &) = delete;
+    StaticFile &operator=(const StaticFile &) = delete;
+
+    /// Open descriptor, or -1 if the whole file is in contents
+    int fd = -1;
+    std::uint64_t size = 0;
+    std::string etag;
+    std::string lastModified;
+    std::string_view contentType;
+    std::string contents;
+
+    bool inMemory() const noexcept
+    {
+        return fd == -1;
+    }
+};
+
+/**
+ * @brief Serves GET and HEAD requests from the document root.
+ *
+ * Responses carry an ETag built from the file's size and modification time, and answer If-None-Match with
+ * 304 Not Modified. A single byte range may be requested with Range, optionally guarded by If-Range; requests
+ * for several ranges get the whole file. Small files are copied into the response from memory. Larger ones are
+ * left out of it, and the session sends them straight from the file descriptor after writing the header.
+ */
+class StaticFiles
+{
+public:
+    /// The part of a file to send from its descriptor after the response header
+    struct Body
+    {
+        std::shared_ptr<const StaticFile> file;
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+    };
+
+    using CacheStats = ShardedLruCache<std::string, std::shared_ptr<const StaticFile>>::Stats;
+
+    StaticFiles(std::string docRoot, StaticFileOptions options);
+
+    bool enabled() const noexcept
+    {
+        return options_.enabled && !docRoot_.empty();
+    }
+
+    /**
+     * @brief Fill in the response for a file, if the request target names one.
+     *
+     * @param req A GET or HEAD request
+     * @param res The response
+     * @param body Receives the part of the file to send after the header, unless it was put into res
+     * @return false if no file matches the target, in which case res is untouched
+     */
+    bool serve(const HttpRequest &req, HttpResponse &res, Body &body) const;
+
+    CacheStats cacheStats() const
+    {
+        return cache_.stats();
+    }
+
+private:
+    std::shared_ptr<const StaticFile> open(const std::string &path) const;
+
+    std::string docRoot_;
+    StaticFileOptions options_;
+    mutable ShardedLruCache<std::string, std::shared_ptr<const StaticFile>> cache_;
+};
+
+#endif //CCFOLIO_STATICFILES_H
@@ -0,0 +1,149 @@
+#include "TopicRegistry.h"
+#include <algorithm>
+#include <mutex>
+
+struct TopicRegistry::Topic
+{
+    explicit Topic(std::string_view topicName) : name(topicName)
+    {
+    }
+
+    std::string const name;
+    BroadcastGroup subscribers;
+    std::atomic<std::uint64_t> published{0};
+    std::atomic<std::uint64_t> delivered{0};
+};
+
+TopicRegistry::TopicRegistry() = default;
+
+TopicRegistry::~TopicRegistry() = default;
+
+TopicRegistry::Shard &TopicRegistry::shardFor(std::string_view topic) const
+{
+    return shards_[std::hash<std::string_view>{}(topic) % ShardCount];
+}
+
+/**
+     * @brief Add a session to a topic, creating the topic if needed. Must be called on the session's executor,
+     * at most once per topic and session.
+     */
+void TopicRegistry::subscribe(std::string_view topic, WebSocketSession &session)
+{
+    auto &shard = shardFor(topic);
+    {
+        // Joining under the shared lock keeps unsubscribe from removing the topic in between
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.topics.find(topic);
+        if (it != shard.topics.end())
+        {
+            it->second->subscribers.join(session);
+            return;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.topics.find(topic);
+    if (it == shard.topics.end())
+    {
+        auto created = std::make_shared<Topic>(topic);
+        it = shard.topics.emplace(created->name, created).first;
+    }
+    it->second->subscribers.join(session);
+}
+
+/**
+     * @brief Remove a session from a topic. The topic is removed once its last subscriber has left.
+     */
+void TopicRegistry::unsubscribe(std::string_view topic, WebSocketSession &session)
+{
+    auto &shard = shardFor(topic);
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.topics.find(topic);
+        if (it == shard.topics.end())
+            return;
+
+        it->second->subscribers.leave(session);
+        if (it->second->subscribers.size() != 0)
+            return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.topics.find(topic);
+    if (it != shard.topics.end() && it->second->subscribers.size() == 0)
+        shard.topics.erase(it);
+}
+
+/**
+     * @brief Send a message to every subscriber of a topic. Publishing to a topic without subscribers does nothing.
+     */
+std::size_t TopicRegistry::publish(std::string_view topic, boost::shared_ptr<std::string const> const &message) const
+{
+    std::shared_ptr<Topic> target;
+    {
+        auto &shard = shardFor(topic);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.topics.find(topic);
+        if (it == shard.topics.end())
+            return 0;
+        target = it->second;
+    }
+
+    auto subscribers = target->subscribers.size();
+    target->subscribers.broadcast(message);
+    target->published.fetch_add(1, std::memory_order_relaxed);
+    target->delivered.fetch_add(subscribers, std::memory_order_relaxed);
+    published_.add();
+    delivered_.add(subscribers);
+    return subscribers;
+}
+
+std::size_t TopicRegistry::topicCount() const
+{
+    std::size_t count = 0;
+    for (auto &shard : shards_)
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        count += shard.topics.size();
+    }
+    return count;
+}
+
+TopicRegistry::Totals TopicRegistry::totals() const
+{
+    return {published_.value(), delivered_.value()};
+}
+
+/**
+     * @brief Fan-out counters for every topic that currently has subscribers.
+     * delivered counts the subscribers each message was sent to.
+     */
+std::vector<TopicRegistry::TopicStats> TopicRegistry::stats() const
+{
+    std::vector<TopicStats> result;
+    for (auto &shard : shards_)
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (auto const &[name, topic] : shard.topics)
+        {
+            result.push_back({topic->name,
+                              topic->subscribers.size(),
+                              topic->published.load(std::memory_order_relaxed),
+                              topic->delivered.load(std::memory_order_relaxed)});
+        }
+    }
+    return result;
+}
+
+/**
+     * @brief Fan-out counters of the topics that delivered the most messages, at most limit of them.
+     */
+std::vector<TopicRegistry::TopicStats> TopicRegistry::busiestTopics(std::size_t limit) const
+{
+    auto result = stats();
+    auto busier = [](TopicStats const &a, TopicStats const &b) { return a.delivered > b.delivered; };
+    auto count = std::min(limit, result.size());
+    std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(count), result.end(), busier);
+    result.resize(count);
+    return result;
+}
@@ -0,0 +1,85 @@
+//
+// Created by fred on 4/30/24.
+//
+
+#ifndef CCFOLIO_TOPICREGISTRY_H
+#define CCFOLIO_TOPICREGISTRY_H
+
+#include "BroadcastGroup.h"
+#include "Metrics.h"
+#include <array>
+#include <atomic>
+#include <boost/smart_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class WebSocketSession;
+
+/**
+ * @brief Named topics, each with its own set of subscribed sessions.
+ *
+ * Publishing reaches only the subscribers of one topic, so its cost does not depend on how many sessions are
+ * connected. Topics are spread over shards by name, each guarded by a reader-writer lock. Publishing and
+ * subscribing to an existing topic only take a shared lock; creating a topic and removing it once its last
+ * subscriber leaves take the exclusive lock of one shard.
+ */
+class TopicRegistry
+{
+public:
+    struct TopicStats
+    {
+        std::string name;
+        std::size_t subscribers;
+        std::uint64_t published;
+        std::uint64_t delivered;
+    };
+
+    /// Fan-out counters of all topics, including those that have since been removed
+    struct Totals
+    {
+        std::uint64_t published;
+        std::uint64_t delivered;
+    };
+
+    TopicRegistry();
+    ~TopicRegistry();
+    TopicRegistry(const TopicRegistry &) = delete;
+    TopicRegistry &operator=(const TopicRegistry &) = delete;
+
+    void subscribe(std::string_view topic, WebSocketSession &session);
+    void unsubscribe(std::string_view topic, WebSocketSession &session);
+
+    /// @return The number of subscribers the message was sent to
+    std::size_t publish(std::string_view topic, boost::shared_ptr<std::string const> const &message) const;
+
+    std::size_t topicCount() const;
+    Totals totals() const;
+    std::vector<TopicStats> stats() const;
+    std::vector<TopicStats> busiestTopics(std::size_t limit) const;
+
+private:
+    struct Topic;
+
+    static constexpr std::size_t ShardCount = 16;
+
+    struct Shard
+    {
+        std::shared_mutex mutex;
+        // Keys point into the topic's own name, so lookups need no string
+        std::unordered_map<std::string_view, std::shared_ptr<Topic>> topics;
+    };
+
+    Shard &shardFor(std::string_view topic) const;
+
+    mutable std::array<Shard, ShardCount> shards_;
+    mutable Counter published_;
+    mutable Counter delivered_;
+};
+
+#endif //CCFOLIO_TOPICREGISTRY_H
@@ -0,0 +1,115 @@
+#include "WebSocketRouter.h"
+#include "LogService.h"
+#include "SharedState.h"
+#include "WebSocketSession.h"
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+WebSocketContext::WebSocketContext(boost::shared_ptr<WebSocketSession> session, std::string command, json id)
+    : session_(std::move(session)), command_(std::move(command)), id_(std::move(id))
+{
+}
+
+void WebSocketContext::reply(const json &data) const
+{
+    json message = {{"command", command_}, {"data", data}};
+    if (!id_.is_null())
+        message["id"] = id_;
+    session_->send(boost::make_shared<std::string const>(message.dump()));
+}
+
+void WebSocketContext::error(std::string_view text) const
+{
+    json message = {{"command", command_}, {"error", text}};
+    if (!id_.is_null())
+        message["id"] = id_;
+    session_->send(boost::make_shared<std::string const>(message.dump()));
+}
+
+void WebSocketContext::broadcast(const json &data) const
+{
+    session_->state().send(json{{"command", command_}, {"data", data}}.dump());
+}
+
+bool WebSocketContext::subscribe(std::string_view topic) const
+{
+    return session_->subscribe(topic);
+}
+
+bool WebSocketContext::unsubscribe(std::string_view topic) const
+{
+    return session_->unsubscribe(topic);
+}
+
+std::size_t WebSocketContext::publish(std::string_view topic, const json &data) const
+{
+    return session_->state().publish(topic, json{{"topic", topic}, {"data", data}}.dump());
+}
+
+SharedState &WebSocketContext::state() const noexcept
+{
+    return session_->state();
+}
+
+/**
+     * @brief Register a handler for a command.
+     *
+     * @throws std::logic_error if the router has been frozen
+     * @throws std::invalid_argument if the command is empty or already registered
+     */
+void WebSocketRouter::addCommand(std::string_view command, WebSocketHandler handler)
+{
+    if (frozen_)
+        throw std::logic_error("Commands cannot be added after the router has been frozen");
+
+    if (command.empty())
+        throw std::invalid_argument("Websocket command must not be empty");
+
+    if (!handlers_.emplace(std::string(command), std::move(handler)).second)
+        throw std::invalid_argument("Duplicate websocket command: " + std::string(command));
+}
+
+/**
+     * @brief Parse a message and call the handler for its command.
+     * Invalid messages, unknown commands and handlers that throw are answered with an error message.
+     *
+     * @param message The message text, parsed in place
+     * @param session The session the message arrived on
+     * @return Whether a handler ran, or why not
+     */
+WebSocketRouter::Result WebSocketRouter::dispatch(std::string_view message,
+                                                  boost::shared_ptr<WebSocketSession> const &session) const
+{
+    auto parsed = json::parse(message.begin(), message.end(), nullptr, false);
+    auto command = parsed.is_object() ? parsed.find("command") : parsed.end();
+    if (parsed.is_discarded() || command == parsed.end() || !command->is_string())
+    {
+        session->send(boost::make_shared<std::string const>(json{{"error", "Invalid message"}}.dump()));
+        return Result::InvalidMessage;
+    }
+
+    auto id = parsed.find("id");
+    WebSocketContext ctx(session, command->get<std::string>(), id != parsed.end() ? std::move(*id) : json());
+
+    auto handler = handlers_.find(ctx.command());
+    if (handler == handlers_.end())
+    {
+        ctx.error("Unknown command");
+        return Result::UnknownCommand;
+    }
+
+    static const json noData;
+    auto data = parsed.find("data");
+    try
+    {
+        handler->second(data != parsed.end() ? *data : noData, ctx);
+    }
+    catch (const std::exception &e)
+    {
+        LOGF(LogService::LogLevel::ERROR, "Websocket command {0} failed: {1}", ctx.command(), e.what());
+        ctx.error("Internal error");
+        return Result::HandlerFailed;
+    }
+    return Result::Handled;
+}
@@ -0,0 +1,109 @@
+//
+// Created by fred on 4/29/24.
+//
+
+#ifndef CCFOLIO_WEBSOCKETROUTER_H
+#define CCFOLIO_WEBSOCKETROUTER_H
+
+#include <boost/smart_ptr.hpp>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+
+class SharedState;
+class WebSocketSession;
+
+/**
+ * @brief The session and command a websocket message was routed for.
+ * A context may be copied and used after the handler returns, from any thread.
+ */
+class WebSocketContext
+{
+public:
+    WebSocketContext(boost::shared_ptr<WebSocketSession> session,
+                     std::string command,
+                     nlohmann::json id = nullptr);
+
+    const std::string &command() const noexcept
+    {
+        return command_;
+    }
+
+    /// Correlation id sent by the client, null if there was none
+    const nlohmann::json &id() const noexcept
+    {
+        return id_;
+    }
+
+    /// Send data to this session only, tagged with the command and the client's id
+    void reply(const nlohmann::json &data) const;
+
+    /// Send an error for this command to this session only
+    void error(std::string_view message) const;
+
+    /// Send data to every session, tagged with the command
+    void broadcast(const nlohmann::json &data) const;
+
+    /// Subscribe this session to a topic. Only valid while the handler runs. @return false if already subscribed
+    bool subscribe(std::string_view topic) const;
+    /// Unsubscribe this session from a topic. Only valid while the handler runs. @return false if not subscribed
+    bool unsubscribe(std::string_view topic) const;
+    /// Send data to the subscribers of a topic, tagged with the topic. @return The number of subscribers
+    std::size_t publish(std::string_view topic, const nlohmann::json &data) const;
+
+    SharedState &state() const noexcept;
+
+private:
+    boost::shared_ptr<WebSocketSession> session_;
+    std::string command_;
+    nlohmann::json id_;
+};
+
+/**
+ * @brief Handler for one websocket command.
+ * data is the message's "data" member, or null if it has none, and is only valid until the handler returns.
+ */
+using WebSocketHandler = std::function<void(const nlohmann::json &data, const WebSocketContext &ctx)>;
+
+/**
+ * @brief Routes websocket messages to handlers by their command.
+ *
+ * Messages are JSON objects of the form {"command": "...", "id": ..., "data": ...}, where id and data are
+ * optional. The message is parsed straight from the session's read buffer. Like Router, commands are registered
+ * during startup and the router is then frozen, after which lookups need no locks.
+ */
+class WebSocketRouter
+{
+public:
+    enum class Result
+    {
+        Handled,
+        InvalidMessage,
+        UnknownCommand,
+        HandlerFailed
+    };
+
+    void addCommand(std::string_view command, WebSocketHandler handler);
+
+    void freeze() noexcept
+    {
+        frozen_ = true;
+    }
+
+    bool isFrozen() const noexcept
+    {
+        return frozen_;
+    }
+
+    Result dispatch(std::string_view message, boost::shared_ptr<WebSocketSession> const &session) const;
+
+private:
+    // std::less<> lets the string_view from the message be looked up without building a string
+    std::map<std::string, WebSocketHandler, std::less<>> handlers_;
+    bool frozen_ = false;
+};
+
+#endif //CCFOLIO_WEBSOCKETROUTER_H
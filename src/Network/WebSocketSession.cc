@@ -1,16 +1,23 @@
 #include "WebSocketSession.h"
 #include "LogService.h"
 #include "fmt/format.h"
+#include <algorithm>
 #include <iostream>
 
-WebSocketSession::WebSocketSession(tcp::socket &&socket, boost::shared_ptr<SharedState> const &state)
-    : ws_(std::move(socket)), state_(state)
+WebSocketSession::WebSocketSession(tcp::socket &&socket,
+                                   boost::shared_ptr<SharedState> const &state,
+                                   WebSocketRouter const &router)
+    : ws_(std::move(socket)), state_(state), router_(router), queue_(state->sendQueueOptions())
 {
 }
 
 WebSocketSession::~WebSocketSession()
 {
+    for (auto const &topic : topics_)
+        state_->unsubscribe(topic, *this);
     state_->leave(this);
+    if (deflate_)
+        state_->deflateSessionClosed();
 }
 
 void WebSocketSession::fail(beast::error_code ec, char const *what)
@@ -18,14 +25,19 @@ void WebSocketSession::fail(beast::error_code ec, char const *what)
     if (ec == net::error::operation_aborted || ec == websocket::error::closed)
         return;
 
-    LOG(LogService::LogLevel::ERROR, fmt::format("{0}: {1}", what, ec.message()));
+    LOGF(LogService::LogLevel::ERROR, "{0}: {1}", what, ec.message());
 }
 
 void WebSocketSession::on_accept(beast::error_code ec)
 {
     if (ec)
+    {
+        deflate_ = false;
         return fail(ec, "accept");
+    }
 
+    if (deflate_)
+        state_->deflateSessionOpened();
     state_->join(this);
 
     ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::on_read, shared_from_this()));
@@ -36,15 +48,36 @@ void WebSocketSession::on_read(beast::error_code ec, std::size_t)
     if (ec)
         return fail(ec, "read");
 
-    auto message = beast::buffers_to_string(buffer_.data());
-
-    // TODO: Parse the message for commands
+    // A flat_buffer holds the whole message in one piece, so the router can parse it where it lies
+    auto data = buffer_.cdata();
+    router_.dispatch(std::string_view(static_cast<char const *>(data.data()), data.size()), shared_from_this());
 
     buffer_.consume(buffer_.size());
 
     ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::on_read, shared_from_this()));
 }
 
+bool WebSocketSession::subscribe(std::string_view topic)
+{
+    if (std::find(topics_.begin(), topics_.end(), topic) != topics_.end())
+        return false;
+
+    state_->subscribe(topic, *this);
+    topics_.emplace_back(topic);
+    return true;
+}
+
+bool WebSocketSession::unsubscribe(std::string_view topic)
+{
+    auto it = std::find(topics_.begin(), topics_.end(), topic);
+    if (it == topics_.end())
+        return false;
+
+    state_->unsubscribe(topic, *this);
+    topics_.erase(it);
+    return true;
+}
+
 void WebSocketSession::send(boost::shared_ptr<std::string const> const &ss)
 {
     net::post(ws_.get_executor(), beast::bind_front_handler(&WebSocketSession::on_send, shared_from_this(), ss));
@@ -52,13 +85,30 @@ void WebSocketSession::send(boost::shared_ptr<std::string const> const &ss)
 
 void WebSocketSession::on_send(boost::shared_ptr<std::string const> const &ss)
 {
-    queue_.push_back(ss);
+    if (closing_)
+        return;
 
-    if (queue_.size() > 1)
+    if (!queue_.push(ss))
+    {
+        LOGF(LogService::LogLevel::WARN,
+             "Disconnecting slow websocket client with {0} messages and {1} bytes waiting",
+             queue_.depth(),
+             bytesInFlight());
+        closing_ = true;
+        // Closing the socket cancels the pending read and write, which releases the session
+        beast::get_lowest_layer(ws_).close();
         return;
+    }
 
-    ws_.async_write(net::buffer(*queue_.front()),
-                    beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this()));
+    if (!writing_)
+        do_write();
+}
+
+void WebSocketSession::do_write()
+{
+    writing_ = queue_.pop();
+    writingBytes_.store(writing_->size(), std::memory_order_relaxed);
+    ws_.async_write(net::buffer(*writing_), beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this()));
 }
 
 void WebSocketSession::on_write(beast::error_code ec, std::size_t)
@@ -66,9 +116,9 @@ void WebSocketSession::on_write(beast::error_code ec, std::size_t)
     if (ec)
         return fail(ec, "write");
 
-    queue_.erase(queue_.begin());
+    writing_.reset();
+    writingBytes_.store(0, std::memory_order_relaxed);
 
     if (!queue_.empty())
-        ws_.async_write(net::buffer(*queue_.front()),
-                        beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this()));
+        do_write();
 }
@@ -7,11 +7,15 @@
 
 #include "Beast.h"
 #include "Net.h"
+#include "SendQueue.h"
 #include "SharedState.h"
+#include "WebSocketRouter.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class SharedState;
@@ -21,15 +25,27 @@ class WebSocketSession : public boost::enable_shared_from_this<WebSocketSession>
     beast::flat_buffer buffer_;
     websocket::stream<beast::tcp_stream> ws_;
     boost::shared_ptr<SharedState> state_;
-    std::vector<boost::shared_ptr<std::string const>> queue_;
+    WebSocketRouter const &router_;
+    SendQueue queue_;
+    // The message being written, kept out of the queue so that the policy never drops it
+    SendQueue::Message writing_;
+    std::atomic<std::size_t> writingBytes_{0};
+    bool closing_ = false;
+    // Set by the handshake decorator when the client accepted permessage-deflate
+    bool deflate_ = false;
+    // Topics this session is subscribed to, so it can leave them when it is destroyed
+    std::vector<std::string> topics_;
 
     void fail(beast::error_code ec, char const *what);
     void on_accept(beast::error_code ec);
     void on_read(beast::error_code ec, std::size_t bytes_transferred);
+    void do_write();
     void on_write(beast::error_code ec, std::size_t bytes_transferred);
 
 public:
-    WebSocketSession(tcp::socket &&socket, boost::shared_ptr<SharedState> const &state);
+    WebSocketSession(tcp::socket &&socket,
+                     boost::shared_ptr<SharedState> const &state,
+                     WebSocketRouter const &router);
 
     ~WebSocketSession();
 
@@ -38,7 +54,37 @@ public:
 
     void send(boost::shared_ptr<std::string const> const &ss);
 
+    /// Subscribe to a topic. Must be called on the session's executor. @return false if already subscribed
+    bool subscribe(std::string_view topic);
+    /// Unsubscribe from a topic. Must be called on the session's executor. @return false if not subscribed
+    bool unsubscribe(std::string_view topic);
+
+    SharedState &state() const noexcept
+    {
+        return *state_;
+    }
+
+    net::any_io_executor executor()
+    {
+        return ws_.get_executor();
+    }
+
+    /// Messages waiting behind the one being written
+    std::size_t queueDepth() const noexcept
+    {
+        return queue_.depth();
+    }
+
+    /// Bytes waiting or being written
+    std::size_t bytesInFlight() const noexcept
+    {
+        return queue_.bytes() + writingBytes_.load(std::memory_order_relaxed);
+    }
+
 private:
+    // Broadcasts call on_send directly when they already run on the session's executor
+    friend class BroadcastGroup;
+
     void on_send(boost::shared_ptr<std::string const> const &ss);
 };
 
@@ -47,8 +93,13 @@ void WebSocketSession::run(http::request<Body, http::basic_fields<Allocator>> re
 {
     ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
 
-    ws_.set_option(websocket::stream_base::decorator([](websocket::response_type &res) {
+    ws_.set_option(state_->deflateOptions().toBeast());
+
+    ws_.set_option(websocket::stream_base::decorator([this](websocket::response_type &res) {
         res.set(http::field::server, std::string(BOOST_BEAST_VERSION_STRING) + " websocket-chat-multi");
+        // The decorator runs after the extensions have been negotiated
+        deflate_ = res.result() == http::status::switching_protocols &&
+                   res[http::field::sec_websocket_extensions].find("permessage-deflate") != beast::string_view::npos;
     }));
 
     ws_.async_accept(req, beast::bind_front_handler(&WebSocketSession::on_accept, shared_from_this()));
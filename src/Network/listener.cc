@@ -1,4 +1,5 @@
 #include "Listener.h"
+#include "HttpMetrics.h"
 #include "HttpSession.h"
 #include "LogService.h"
 #include "fmt/format.h"
@@ -7,8 +8,10 @@
 Listener::Listener(net::io_context &ioc,
                    tcp::endpoint endpoint,
                    boost::shared_ptr<SharedState> const &state,
-                   Router &router)
-    : ioc_(ioc), acceptor_(ioc), state_(state), router_(router)
+                   Router &router,
+                   WebSocketRouter const &webSocketRouter,
+                   ListenerMode mode)
+    : ioc_(ioc), acceptor_(ioc), state_(state), router_(router), webSocketRouter_(webSocketRouter), mode_(mode)
 {
     beast::error_code ec;
 
@@ -26,6 +29,20 @@ Listener::Listener(net::io_context &ioc,
         return;
     }
 
+    if (mode_ == ListenerMode::PerThread)
+    {
+#ifdef SO_REUSEPORT
+        acceptor_.set_option(net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+#else
+        ec = net::error::operation_not_supported;
+#endif
+        if (ec)
+        {
+            fail(ec, "reuse_port");
+            return;
+        }
+    }
+
     acceptor_.bind(endpoint, ec);
     if (ec)
     {
@@ -43,7 +60,17 @@ Listener::Listener(net::io_context &ioc,
 
 void Listener::run()
 {
-    acceptor_.async_accept(net::make_strand(ioc_), beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
+    do_accept();
+}
+
+void Listener::do_accept()
+{
+    // A single-threaded io_context already serialises a connection's handlers, so it needs no strand
+    if (mode_ == ListenerMode::PerThread)
+        acceptor_.async_accept(ioc_, beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
+    else
+        acceptor_.async_accept(net::make_strand(ioc_),
+                               beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
 }
 
 void Listener::fail(beast::error_code ec, char const *what)
@@ -51,15 +78,19 @@ void Listener::fail(beast::error_code ec, char const *what)
     if (ec == net::error::operation_aborted)
         return;
 
-    LOG(LogService::LogLevel::ERROR, fmt::format("{0}: {1}", what, ec.message()));
+    LOGF(LogService::LogLevel::ERROR, "{0}: {1}", what, ec.message());
 }
 
 void Listener::on_accept(beast::error_code ec, tcp::socket socket)
 {
     if (ec)
+    {
+        if (ec != net::error::operation_aborted)
+            HttpMetrics::getInstance().acceptErrors.add();
         return fail(ec, "accept");
-    else
-        boost::make_shared<HttpSession>(std::move(socket), state_, router_)->run();
+    }
 
-    acceptor_.async_accept(net::make_strand(ioc_), beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
+    HttpMetrics::getInstance().acceptedConnections.add();
+    boost::make_shared<HttpSession>(std::move(socket), state_, router_, webSocketRouter_)->run();
+    do_accept();
 }
@@ -5,6 +5,7 @@
 #include "JWTHelper.h"
 #include <LogService.h>
 #include <config.hpp>
+#include <functional>
 #include <jwt-cpp/jwt.h>
 
 /// @brief The secret key used for signing and verifying tokens
@@ -43,27 +44,96 @@ std::string JWTHelper::CreateJWTToken(const std::string &username)
     }
 }
 
+namespace
+{
+JWTHelper::TokenCache &tokenCache()
+{
+    static JWTHelper::TokenCache cache(4096, 16);
+    return cache;
+}
+
+/// The verifier only holds the key and the expected claims, so one instance is shared by all threads
+const auto &tokenVerifier()
+{
+    static const auto verifier = jwt::verify().allow_algorithm(jwt::algorithm::hs256{secretKey}).with_issuer(issuer);
+    return verifier;
+}
+} // namespace
+
 /**
-     * @brief Verifies a jwt token
+     * @brief Verifies a jwt token.
+     * Tokens that pass are cached until they expire, so repeated calls with the same token skip decoding and the HMAC.
      *
      * @param token The token to verify
-     * @return true if the token is valid, false otherwise
+     * @return The verified claims, or nullptr if the token is invalid or expired
      */
-bool JWTHelper::VerifyToken(const std::string &token)
+std::shared_ptr<const JWTHelper::VerifiedToken> JWTHelper::VerifyToken(std::string_view token)
 {
+    auto digest = static_cast<std::uint64_t>(std::hash<std::string_view>{}(token));
+
+    // The digest only selects the entry, the full token is compared so a hash collision can never authenticate
+    if (auto cached = tokenCache().get(digest); cached && (*cached)->token == token)
+        return *cached;
+
     try
     {
-        auto decoded = jwt::decode(token);
-        auto verifier = jwt::verify().allow_algorithm(jwt::algorithm::hs256{secretKey}).with_issuer(issuer);
+        auto decoded = jwt::decode(std::string(token));
+
+        std::error_code ec;
+        tokenVerifier().verify(decoded, ec);
+        if (ec)
+        {
+            LOGF(LogService::LogLevel::ERROR, "Error while trying to verify token. Error: {0}", ec.message());
+            return nullptr;
+        }
+
+        auto verified = std::make_shared<VerifiedToken>();
+        verified->token = decoded.get_token();
+        if (decoded.has_payload_claim("username"))
+            verified->username = decoded.get_payload_claim("username").as_string();
 
-        verifier.verify(decoded);
-        return true;
+        if (decoded.has_expires_at())
+        {
+            verified->expiresAt = decoded.get_expires_at();
+            tokenCache().put(digest, verified, verified->expiresAt);
+        }
+
+        return verified;
     }
     catch (const std::exception &e)
     {
-        LOG(LogService::LogLevel::ERROR, fmt::format("Error while trying to verify token. Error: {0}", e.what()));
+        LOGF(LogService::LogLevel::ERROR, "Error while trying to verify token. Error: {0}", e.what());
     }
-    return false;
+    return nullptr;
+}
+
+/**
+     * @brief Verifies the bearer token in a request's Authorization header, for requests whose response is not an
+     * HttpResponse, such as streaming routes.
+     *
+     * @param req The request header
+     * @return The verified claims, or nullptr if the header is missing or its token is invalid
+     */
+std::shared_ptr<const JWTHelper::VerifiedToken> JWTHelper::VerifyRequest(const HttpRequestHeader &req)
+{
+    auto authHeader = req.find(http::field::authorization);
+    if (authHeader == req.end())
+        return nullptr;
+
+    auto header = authHeader->value();
+    std::string_view value(header.data(), header.size());
+    constexpr std::string_view prefix = "Bearer ";
+    if (value.substr(0, prefix.size()) != prefix)
+        return nullptr;
+    return VerifyToken(value.substr(prefix.size()));
+}
+
+/**
+     * @brief Hit, miss and eviction counters of the verified token cache.
+     */
+JWTHelper::TokenCacheStats JWTHelper::CacheStats()
+{
+    return tokenCache().stats();
 }
 
 /**
@@ -87,8 +157,10 @@ bool JWTHelper::ValidateToken(const HttpRequest &req, HttpResponse &res)
             return false;
         }
 
-        std::string token = std::string(authHeader->value());
-        if (token.find("Bearer ") != 0)
+        auto header = authHeader->value();
+        std::string_view value(header.data(), header.size());
+        constexpr std::string_view prefix = "Bearer ";
+        if (value.substr(0, prefix.size()) != prefix)
         {
             res.result(http::status::unauthorized);
             res.set(http::field::content_type, "application/json");
@@ -96,9 +168,7 @@ bool JWTHelper::ValidateToken(const HttpRequest &req, HttpResponse &res)
             res.prepare_payload();
             return false;
         }
-        token = token.substr(7); // Remove "Bearer " prefix
-
-        if (!VerifyToken(token))
+        if (!VerifyToken(value.substr(prefix.size())))
         {
             res.result(http::status::unauthorized);
             res.set(http::field::content_type, "application/json");
@@ -111,7 +181,7 @@ bool JWTHelper::ValidateToken(const HttpRequest &req, HttpResponse &res)
     }
     catch (const std::exception &e)
     {
-        LOG(LogService::LogLevel::ERROR, fmt::format("Error while trying to validate token. Error: {0}", e.what()));
+        LOGF(LogService::LogLevel::ERROR, "Error while trying to validate token. Error: {0}", e.what());
     }
     return false;
 }
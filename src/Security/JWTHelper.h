@@ -6,14 +6,36 @@
 #define CCFOLIO_JWTHELPER_H
 
 #include <Router.h>
+#include <ShardedLruCache.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 
 class JWTHelper
 {
 public:
+    /// Claims of a token that passed verification
+    struct VerifiedToken
+    {
+        std::string token;
+        std::string username;
+        std::chrono::system_clock::time_point expiresAt;
+    };
+
+    /// Verified tokens keyed by a digest of the token, each entry expires together with its token
+    using TokenCache = ShardedLruCache<std::uint64_t,
+                                       std::shared_ptr<const VerifiedToken>,
+                                       std::hash<std::uint64_t>,
+                                       std::chrono::system_clock>;
+    using TokenCacheStats = TokenCache::Stats;
+
     static std::string CreateJWTToken(const std::string &username);
-    static bool VerifyToken(const std::string &token);
+    static std::shared_ptr<const VerifiedToken> VerifyToken(std::string_view token);
     static bool ValidateToken(const HttpRequest &req, HttpResponse &res);
+    static std::shared_ptr<const VerifiedToken> VerifyRequest(const HttpRequestHeader &req);
+    static TokenCacheStats CacheStats();
 };
 
 
@@ -0,0 +1,113 @@
+//
+// Created by fred on 4/20/24.
+//
+
+#include "PasswordHashExecutor.h"
+#include "LogService.h"
+#include "PasswordHelper.h"
+#include <algorithm>
+
+/**
+     * @brief Start the worker threads.
+     *
+     * @param threads Number of hashes that may run at the same time
+     * @param queueCapacity Number of hashes that may wait for a thread before submissions are refused. With 0, a
+     * hash is only accepted while a thread is free to take it.
+     */
+PasswordHashExecutor::PasswordHashExecutor(std::size_t threads, std::size_t queueCapacity) : capacity(queueCapacity)
+{
+    threads = std::max<std::size_t>(1, threads);
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+        workers.emplace_back(&PasswordHashExecutor::workerLoop, this);
+}
+
+/**
+     * @brief Finish the queued work and join the worker threads.
+     */
+PasswordHashExecutor::~PasswordHashExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+/**
+     * @brief Number of threads whose concurrent hashes fit in a memory budget.
+     *
+     * @param memoryBudgetBytes Memory the pool may use for Argon2
+     * @return The thread count, at least one
+     */
+std::size_t PasswordHashExecutor::ThreadsForMemoryBudget(std::size_t memoryBudgetBytes)
+{
+    constexpr std::size_t perHash = std::size_t{PasswordHelper::Argon2MemoryCostKiB} * 1024;
+    return std::max<std::size_t>(1, memoryBudgetBytes / perHash);
+}
+
+/**
+     * @brief Queue a task unless the queue is full. Tasks that an idle worker is about to take do not count as
+     * waiting, so they never fill the queue.
+     *
+     * @param task The task to run on a worker thread
+     * @return true if the task was queued
+     */
+bool PasswordHashExecutor::trySubmit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping || tasks.size() >= capacity + idleWorkers)
+        {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+    return true;
+}
+
+std::size_t PasswordHashExecutor::memoryBudget() const noexcept
+{
+    return workers.size() * std::size_t{PasswordHelper::Argon2MemoryCostKiB} * 1024;
+}
+
+std::size_t PasswordHashExecutor::queueDepth() const
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return tasks.size();
+}
+
+void PasswordHashExecutor::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            ++idleWorkers;
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            --idleWorkers;
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        try
+        {
+            task();
+        }
+        catch (const std::exception &e)
+        {
+            LOG(LogService::LogLevel::ERROR, e.what());
+        }
+        completed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
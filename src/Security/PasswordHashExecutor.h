@@ -0,0 +1,140 @@
+//
+// Created by fred on 4/20/24.
+//
+
+#ifndef CCFOLIO_PASSWORDHASHEXECUTOR_H
+#define CCFOLIO_PASSWORDHASHEXECUTOR_H
+
+#include <Net.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Fixed-size thread pool for Argon2 work, kept off the network threads.
+ *
+ * Every hash holds PasswordHelper::Argon2MemoryCostKiB of memory while it runs, so the number of threads bounds
+ * the memory the pool can use. Submissions beyond the queue capacity are refused instead of queued, which lets
+ * callers answer 503 straight away rather than letting a burst of logins pile up.
+ */
+class PasswordHashExecutor
+{
+public:
+    /// Thrown by run() when the queue is full
+    class Overloaded : public std::runtime_error
+    {
+    public:
+        Overloaded() : std::runtime_error("Password hashing queue is full")
+        {
+        }
+    };
+
+    PasswordHashExecutor(std::size_t threads, std::size_t queueCapacity);
+    ~PasswordHashExecutor();
+    PasswordHashExecutor(const PasswordHashExecutor &) = delete;
+    PasswordHashExecutor &operator=(const PasswordHashExecutor &) = delete;
+
+    static std::size_t ThreadsForMemoryBudget(std::size_t memoryBudgetBytes);
+
+    bool trySubmit(std::function<void()> task);
+
+    /**
+     * @brief Run work on the pool and call handler with its result on the given executor.
+     * The handler is called as handler(std::exception_ptr, Result). If the work throws, the exception is passed on
+     * and Result is value-initialised.
+     *
+     * @param executor Executor to resume on, typically the connection's strand
+     * @param work Callable run on a pool thread
+     * @param handler Completion handler
+     * @return false if the queue is full, in which case neither work nor handler is called
+     */
+    template <class Executor, class Work, class Handler>
+    bool post(const Executor &executor, Work work, Handler handler)
+    {
+        return trySubmit([executor, work = std::move(work), handler = std::move(handler)]() mutable {
+            using Result = std::invoke_result_t<Work &>;
+            std::exception_ptr error;
+            Result result{};
+            try
+            {
+                result = work();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            net::post(executor, [handler = std::move(handler), error, result = std::move(result)]() mutable {
+                handler(error, std::move(result));
+            });
+        });
+    }
+
+    /**
+     * @brief Run work on the pool and block the calling thread until it is done.
+     *
+     * @return The result of work, exceptions thrown by work are rethrown
+     * @throws Overloaded if the queue is full
+     */
+    template <class Work>
+    auto run(Work work) -> std::invoke_result_t<Work &>
+    {
+        using Result = std::invoke_result_t<Work &>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(work));
+        auto future = task->get_future();
+        if (!trySubmit([task] { (*task)(); }))
+            throw Overloaded();
+        return future.get();
+    }
+
+    std::size_t threadCount() const noexcept
+    {
+        return workers.size();
+    }
+
+    std::size_t queueCapacity() const noexcept
+    {
+        return capacity;
+    }
+
+    /// Upper bound on the Argon2 memory in use at any time
+    std::size_t memoryBudget() const noexcept;
+
+    std::size_t queueDepth() const;
+
+    std::uint64_t rejectedCount() const noexcept
+    {
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t completedCount() const noexcept
+    {
+        return completed.load(std::memory_order_relaxed);
+    }
+
+private:
+    void workerLoop();
+
+    std::size_t capacity;
+    mutable std::mutex queueMutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    /// Workers waiting for a task, each queued task is taken by one of them before it counts as waiting
+    std::size_t idleWorkers = 0;
+    std::vector<std::thread> workers;
+    std::atomic<std::uint64_t> rejected{0};
+    std::atomic<std::uint64_t> completed{0};
+};
+
+#endif //CCFOLIO_PASSWORDHASHEXECUTOR_H
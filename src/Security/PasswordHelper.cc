@@ -11,7 +11,7 @@
 #include <jwt-cpp/jwt.h>
 #include <memory>
 #include <random>
-#include <sstream>
+#include <string_view>
 #include <vector>
 
 /**
@@ -55,15 +55,11 @@ std::pair<std::string, std::vector<uint8_t>> PasswordHelper::HashPasswordWithArg
     {
         auto salt = GenerateRandomSalt(16);
 
-        const uint32_t t_cost = 2;
-        const uint32_t m_cost = (1 << 16);
-        const uint32_t parallelism = 1;
+        std::vector<uint8_t> hashRaw(Argon2HashBytes);
 
-        std::vector<uint8_t> hashRaw(32);
-
-        int result = argon2i_hash_raw(t_cost,
-                                      m_cost,
-                                      parallelism,
+        int result = argon2i_hash_raw(Argon2TimeCost,
+                                      Argon2MemoryCostKiB,
+                                      Argon2Parallelism,
                                       password.data(),
                                       password.size(),
                                       salt.data(),
@@ -75,13 +71,7 @@ std::pair<std::string, std::vector<uint8_t>> PasswordHelper::HashPasswordWithArg
             throw std::runtime_error("Hashing failed with Argon2");
         }
 
-        std::stringstream hexStream;
-        for (auto byte : hashRaw)
-        {
-            hexStream << std::hex << std::setfill('0') << std::setw(2) << (int)byte;
-        }
-
-        return {hexStream.str(), salt};
+        return {Utility::toHexString(hashRaw), salt};
     }
     catch (const std::exception &e)
     {
@@ -128,15 +118,11 @@ bool PasswordHelper::VerifyPasswordWithArgon2(const std::string &password,
 {
     try
     {
-        const uint32_t t_cost = 2;
-        const uint32_t m_cost = (1 << 16);
-        const uint32_t parallelism = 1;
+        std::vector<uint8_t> hashRaw(Argon2HashBytes);
 
-        std::vector<uint8_t> hashRaw(32);
-
-        int result = argon2i_hash_raw(t_cost,
-                                      m_cost,
-                                      parallelism,
+        int result = argon2i_hash_raw(Argon2TimeCost,
+                                      Argon2MemoryCostKiB,
+                                      Argon2Parallelism,
                                       password.data(),
                                       password.size(),
                                       salt.data(),
@@ -148,13 +134,9 @@ bool PasswordHelper::VerifyPasswordWithArgon2(const std::string &password,
             throw std::runtime_error("Hashing failed with Argon2");
         }
 
-        std::stringstream hexStream;
-        for (auto byte : hashRaw)
-        {
-            hexStream << std::hex << std::setfill('0') << std::setw(2) << (int)byte;
-        }
-
-        return hexStream.str() == hashHex;
+        char hex[2 * Argon2HashBytes];
+        Utility::encodeHex(hashRaw.data(), hashRaw.size(), hex);
+        return std::string_view(hex, sizeof(hex)) == hashHex;
     }
     catch (const std::exception &e)
     {
@@ -5,12 +5,19 @@
 #ifndef CCFOLIO_PASSWORDHELPER_H
 #define CCFOLIO_PASSWORDHELPER_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 class PasswordHelper
 {
 public:
+    /// Argon2i parameters shared by hashing and verification
+    static constexpr uint32_t Argon2TimeCost = 2;
+    static constexpr uint32_t Argon2MemoryCostKiB = (1 << 16);
+    static constexpr uint32_t Argon2Parallelism = 1;
+    static constexpr size_t Argon2HashBytes = 32;
+
     static std::vector<uint8_t> GenerateRandomSalt(size_t length);
     static std::pair<std::string, std::vector<uint8_t>> HashPasswordWithArgon2(const std::string &password);
     static bool VerifyUserPassword(const std::string &passwordHash,
@@ -2,15 +2,20 @@
 // Created by fred on 3/28/24.
 //
 #include <LogService.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
-std::unique_ptr<LogService> LogService::instance = nullptr;
-std::mutex LogService::instanceMutex;
+// The writer collects entries until it has this many bytes or the flush interval has passed, then writes them at once
+static constexpr std::size_t FlushBytes = 64 * 1024;
 
 /**
      * @brief Construct a new Log Service object and start the worker thread.
      *
      */
-LogService::LogService() : currentLevel(LogLevel::DEBUG), running(true)
+LogService::LogService() : running(true)
 {
     currentLogDate = getCurrentDate();
     openLogFile();
@@ -23,31 +28,31 @@ LogService::LogService() : currentLevel(LogLevel::DEBUG), running(true)
      */
 LogService::~LogService()
 {
-    running = false;
+    {
+        std::lock_guard<std::mutex> lock(workerMutex);
+        running = false;
+    }
     condition.notify_one();
     if (worker.joinable())
     {
         worker.join();
     }
-    if (logFile.is_open())
+    if (logFd >= 0)
     {
-        logFile.close();
+        ::close(logFd);
     }
 }
 
 /**
-     * @brief Get the Log Service object instance. If the instance does not exist, it is created.
+     * @brief Get the Log Service object instance. It is created on first use, which the compiler makes thread safe,
+     * so later calls only check an initialisation flag.
      *
-     * @return Pointer to log service instance.
+     * @return Reference to the log service instance.
      */
 LogService &LogService::getInstance()
 {
-    std::lock_guard<std::mutex> lock(instanceMutex);
-    if (instance == nullptr)
-    {
-        instance.reset(new LogService());
-    }
-    return *instance;
+    static LogService instance;
+    return instance;
 }
 
 /**
@@ -57,11 +62,54 @@ LogService &LogService::getInstance()
      */
 void LogService::setLevel(LogLevel level)
 {
-    currentLevel = level;
+    currentLevel.store(level, std::memory_order_relaxed);
+}
+
+/**
+     * @brief Set what happens to messages logged while the queue is full.
+     *
+     * @param policy The overflow policy to use.
+     */
+void LogService::setOverflowPolicy(OverflowPolicy policy)
+{
+    overflowPolicy.store(policy, std::memory_order_relaxed);
+}
+
+/**
+     * @brief Set the longest time a message may wait in the writer's batch before it is written to the file.
+     *
+     * @param interval The flush interval.
+     */
+void LogService::setFlushInterval(std::chrono::milliseconds interval)
+{
+    flushIntervalMs.store(std::max<std::chrono::milliseconds::rep>(1, interval.count()), std::memory_order_relaxed);
+}
+
+/**
+     * @brief Get the number of written and dropped messages and the current queue depth.
+     */
+LogService::Stats LogService::stats() const
+{
+    return {written.load(std::memory_order_relaxed),
+            dropped.load(std::memory_order_relaxed),
+            batches.load(std::memory_order_relaxed),
+            queue.size()};
+}
+
+/**
+     * @brief Format the message on the writer thread where possible. Only logf() calls with arithmetic arguments
+     * are deferred, everything else is still formatted by the caller.
+     *
+     * @param enabled Whether to defer formatting.
+     */
+void LogService::setDeferredFormatting(bool enabled)
+{
+    deferFormatting.store(enabled, std::memory_order_relaxed);
 }
 
 /**
      * @brief Log a message with the given log level, file, line and function.
+     * The log line is encoded straight into a queue slot, so logging does not allocate.
      *
      * @param message The message to log.
      * @param level The log level of the message.
@@ -69,36 +117,178 @@ void LogService::setLevel(LogLevel level)
      * @param line The line number where the log message is called.
      * @param function The function where the log message is called.
      */
-void LogService::log(const std::string &message,
+void LogService::log(std::string_view message,
                      LogLevel level,
-                     const std::string &file,
+                     std::string_view file,
                      int line,
-                     const std::string &function)
+                     std::string_view function)
 {
-    if (level < currentLevel)
+    if (!isEnabled(level))
         return;
 
-    std::string filename = std::filesystem::path(file).filename().string();
+    auto now = std::time(nullptr);
+    push([&](Entry &slot) {
+        slot.formatter = nullptr;
+        slot.size = static_cast<std::uint32_t>(
+            encodeLine(slot.data, sizeof(slot.data), now, level, file, line, function, message));
+    });
+}
 
-    auto now = std::chrono::system_clock::now();
-    auto now_c = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&now_c), "%Y-%m-%d %X");
-    std::string timestamp = ss.str();
+namespace
+{
+/**
+ * @brief Bounded writer for a single JSON line. Escaped strings stop at the end of the buffer instead of overflowing.
+ */
+class JsonLineWriter
+{
+public:
+    JsonLineWriter(char *out, std::size_t capacity) : begin(out), pos(out), end(out + capacity)
+    {
+    }
 
-    nlohmann::json logJson = {{"timestamp", timestamp},
-                              {"level", logLevelToString(level)},
-                              {"message", message},
-                              {"file", filename},
-                              {"line", line},
-                              {"function", function}};
+    void raw(std::string_view text)
+    {
+        auto n = std::min(text.size(), static_cast<std::size_t>(end - pos));
+        std::memcpy(pos, text.data(), n);
+        pos += n;
+    }
 
-    std::string logEntry = logJson.dump(4);
+    void escaped(std::string_view text)
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        messageQueue.push(logEntry);
+        static constexpr char hex[] = "0123456789abcdef";
+        for (auto c : text)
+        {
+            char escape = 0;
+            switch (c)
+            {
+            case '"':
+                escape = '"';
+                break;
+            case '\\':
+                escape = '\\';
+                break;
+            case '\n':
+                escape = 'n';
+                break;
+            case '\r':
+                escape = 'r';
+                break;
+            case '\t':
+                escape = 't';
+                break;
+            default:
+                break;
+            }
+
+            if (escape != 0)
+            {
+                if (end - pos < 2)
+                    return;
+                *pos++ = '\\';
+                *pos++ = escape;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                if (end - pos < 6)
+                    return;
+                raw("\\u00");
+                *pos++ = hex[(c >> 4) & 0xf];
+                *pos++ = hex[c & 0xf];
+            }
+            else
+            {
+                if (pos == end)
+                    return;
+                *pos++ = c;
+            }
+        }
     }
-    condition.notify_one();
+
+    /// Keep the last bytes free for the closing characters
+    void reserve(std::size_t bytes)
+    {
+        end -= bytes;
+    }
+
+    void release(std::size_t bytes)
+    {
+        end += bytes;
+    }
+
+    std::size_t size() const
+    {
+        return static_cast<std::size_t>(pos - begin);
+    }
+
+private:
+    char *begin;
+    char *pos;
+    char *end;
+};
+
+/**
+ * @brief Local time for a second as text. Each thread caches the text of the last second it formatted,
+ * so the conversion runs at most once per second per thread.
+ */
+std::string_view timestampFor(std::time_t time)
+{
+    struct Cache
+    {
+        std::time_t second = -1;
+        char text[32];
+        std::size_t size = 0;
+    };
+    thread_local Cache cache;
+
+    if (cache.second != time)
+    {
+        std::tm local{};
+        localtime_r(&time, &local);
+        cache.size = std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %X", &local);
+        cache.second = time;
+    }
+    return {cache.text, cache.size};
+}
+} // namespace
+
+/**
+     * @brief Encode a log entry as one line of JSON. If the line does not fit, the message is truncated
+     * and the line is still closed, so every line stays valid JSON.
+     *
+     * @return The number of bytes written.
+     */
+std::size_t LogService::encodeLine(char *out,
+                                   std::size_t capacity,
+                                   std::time_t time,
+                                   LogLevel level,
+                                   std::string_view file,
+                                   int line,
+                                   std::string_view function,
+                                   std::string_view message)
+{
+    static constexpr std::string_view closing = "\"}";
+    JsonLineWriter writer(out, capacity);
+    writer.reserve(closing.size());
+
+    char lineText[16];
+    auto lineEnd = fmt::format_to_n(lineText, sizeof(lineText), "{}", line).out;
+
+    writer.raw("{\"timestamp\":\"");
+    writer.raw(timestampFor(time));
+    writer.raw("\",\"level\":\"");
+    writer.raw(logLevelToString(level));
+    writer.raw("\",\"file\":\"");
+    writer.escaped(file);
+    writer.raw("\",\"line\":");
+    writer.raw(std::string_view(lineText, static_cast<std::size_t>(lineEnd - lineText)));
+    writer.raw(",\"function\":\"");
+    writer.escaped(function);
+    writer.raw("\",\"message\":\"");
+    writer.escaped(message);
+
+    writer.release(closing.size());
+    writer.raw(closing);
+    return writer.size();
 }
 
 /**
@@ -108,11 +298,12 @@ void LogService::log(const std::string &message,
      */
 std::string LogService::getCurrentDate()
 {
-    auto now = std::chrono::system_clock::now();
-    auto nowTimeT = std::chrono::system_clock::to_time_t(now);
-    std::stringstream dateStream;
-    dateStream << std::put_time(std::localtime(&nowTimeT), "%Y-%m-%d");
-    return dateStream.str();
+    auto now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    char date[16];
+    auto size = std::strftime(date, sizeof(date), "%Y-%m-%d", &local);
+    return std::string(date, size);
 }
 
 /**
@@ -120,53 +311,120 @@ std::string LogService::getCurrentDate()
      */
 void LogService::openLogFile()
 {
-    if (logFile.is_open())
+    if (logFd >= 0)
     {
-        logFile.close();
+        ::close(logFd);
     }
     std::string logFileName = "/" + currentLogDate + "-application.log";
     std::string logFilePath = AppPathService::getAppDataPath() + logFileName;
-    logFile.open(logFilePath, std::ios::out | std::ios::app);
-    if (!logFile.is_open())
+    logFd = ::open(logFilePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd < 0)
     {
         std::cerr << "Failed to open log file: " << logFilePath << std::endl;
     }
 }
 
 /**
-     * @brief Process log messages from the queue and write them to the log file.
+     * @brief Drain the queue into a batch and write it to the log file.
      * This function is run in a separate thread.
-     * It will run until the service is stopped and the message queue is empty.
+     * A batch is written once it reaches FlushBytes or the flush interval has passed since the last write.
+     * It will run until the service is stopped and the queue is empty.
      */
 void LogService::processMessages()
 {
-    std::unique_lock<std::mutex> lock(queueMutex, std::defer_lock);
-    while (running || !messageQueue.empty())
+    std::string batch;
+    batch.reserve(FlushBytes + sizeof(Entry) * 2);
+    std::uint64_t reportedDrops = 0;
+    auto lastFlush = std::chrono::steady_clock::now();
+
+    for (;;)
     {
-        lock.lock();
-        condition.wait(lock, [this] { return !running || !messageQueue.empty(); });
-        while (!messageQueue.empty())
+        bool stopping = !running.load();
+        // Cleared before draining, so a producer that crosses half full after this point wakes the writer again
+        wakeRequested.store(false, std::memory_order_release);
+        auto count = queue.drain(
+            [&batch](const Entry &entry) {
+                if (entry.formatter != nullptr)
+                    entry.formatter(entry, batch);
+                else
+                    batch.append(entry.data, entry.size);
+                batch.push_back('\n');
+            },
+            FlushBytes / sizeof(Entry));
+        written.fetch_add(count, std::memory_order_relaxed);
+
+        auto droppedNow = dropped.load(std::memory_order_relaxed);
+        auto policy = overflowPolicy.load(std::memory_order_relaxed);
+        if (droppedNow != reportedDrops && policy == OverflowPolicy::CountAndDrop)
         {
-            std::string msg = messageQueue.front();
-            messageQueue.pop();
-            lock.unlock();
-            if (logFile.is_open())
-            {
-                logFile << msg << std::endl;
-            }
-            lock.lock();
+            char message[64];
+            auto messageEnd =
+                fmt::format_to_n(message, sizeof(message), "{} log messages dropped", droppedNow - reportedDrops).out;
+            char notice[EntrySize];
+            batch.append(notice,
+                         encodeLine(notice,
+                                    sizeof(notice),
+                                    std::time(nullptr),
+                                    LogLevel::WARN,
+                                    LOG_FILE_NAME,
+                                    __LINE__,
+                                    __FUNCTION__,
+                                    std::string_view(message, static_cast<std::size_t>(messageEnd - message))));
+            batch.push_back('\n');
+        }
+        reportedDrops = droppedNow;
+
+        auto interval = std::chrono::milliseconds(flushIntervalMs.load(std::memory_order_relaxed));
+        auto now = std::chrono::steady_clock::now();
+        if (!batch.empty() && (batch.size() >= FlushBytes || now - lastFlush >= interval || stopping))
+        {
+            writeBatch(batch);
+            lastFlush = now;
+        }
+
+        if (count == 0)
+        {
+            if (stopping)
+                break;
+
+            std::unique_lock<std::mutex> lock(workerMutex);
+            condition.wait_for(
+                lock, interval, [this] { return !running.load() || wakeRequested.load(std::memory_order_acquire); });
+        }
+    }
+}
+
+/**
+     * @brief Write a batch to the log file with as few write calls as possible and clear it.
+     *
+     * @param batch The newline separated entries to write.
+     */
+void LogService::writeBatch(std::string &batch)
+{
+    std::size_t offset = 0;
+    while (logFd >= 0 && offset < batch.size())
+    {
+        auto n = ::write(logFd, batch.data() + offset, batch.size() - offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Failed to write log file: " << std::strerror(errno) << std::endl;
+            break;
         }
-        lock.unlock();
+        offset += static_cast<std::size_t>(n);
     }
+    batches.fetch_add(1, std::memory_order_relaxed);
+    batch.clear();
 }
 
 /**
      * @brief Convert a log level to a string.
      *
      * @param level The log level to convert.
-     * @return std::string The log level as a string.
+     * @return std::string_view The log level as a string.
      */
-std::string LogService::logLevelToString(LogLevel level)
+std::string_view LogService::logLevelToString(LogLevel level)
 {
     switch (level)
     {
@@ -13,20 +13,23 @@
 #define LOGSERVICE_HPP
 
 #include "AppConfiguration.h"
+#include "MpscRingBuffer.h"
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
-#include <filesystem>
-#include <fstream>
-#include <iomanip>
+#include <config.hpp>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fmt/format.h>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <nlohmann/json.hpp>
-#include <queue>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 
 class LogService
 {
@@ -39,14 +42,102 @@ public:
         ERROR
     };
 
+    /// What log() does when the queue is full
+    enum class OverflowPolicy
+    {
+        /// Discard the message and count it
+        Drop,
+        /// Wait for the writer to free a slot
+        Block,
+        /// Discard the message, count it and write a line saying how many were lost once there is room
+        CountAndDrop
+    };
+
+    struct Stats
+    {
+        std::uint64_t written;
+        std::uint64_t dropped;
+        std::uint64_t batches;
+        std::size_t queueDepth;
+    };
+
+    /// Bytes a queue slot takes, a log line longer than a slot has its message truncated
+    static constexpr std::size_t EntrySize = 1024;
+    /// Number of entries the queue holds
+    static constexpr std::size_t QueueCapacity = 4096;
+
+    /**
+     * @brief Parse a level name as given to the LOG_MIN_LEVEL CMake option. Unknown names map to DEBUG.
+     */
+    static constexpr LogLevel LevelFromName(std::string_view name)
+    {
+        if (name == "INFO")
+            return LogLevel::INFO;
+        if (name == "WARN")
+            return LogLevel::WARN;
+        if (name == "ERROR")
+            return LogLevel::ERROR;
+        return LogLevel::DEBUG;
+    }
+
+    /// Log calls below this level are compiled out by the LOG and LOGF macros
+    static constexpr LogLevel CompiledMinLevel()
+    {
+        return LevelFromName(log_min_level);
+    }
+
+    /**
+     * @brief File name part of a path. Usable in constant expressions, so the LOG macro resolves it at compile time.
+     */
+    static constexpr std::string_view Basename(std::string_view path)
+    {
+        auto slash = path.find_last_of('/');
+        return slash == std::string_view::npos ? path : path.substr(slash + 1);
+    }
+
 private:
-    LogLevel currentLevel;
-    static std::unique_ptr<LogService> instance;
-    static std::mutex instanceMutex;
-    std::ofstream logFile;
-    std::mutex queueMutex;
+    struct Entry;
+    using DeferredFormatter = void (*)(const Entry &, std::string &);
+
+    /// A queue slot holds either a finished log line, or the call site and raw arguments of a deferred one
+    struct Entry
+    {
+        std::uint32_t size;
+        DeferredFormatter formatter;
+        char data[EntrySize - sizeof(std::uint32_t) - sizeof(DeferredFormatter)];
+    };
+
+    /// Everything but the arguments of a deferred log call. The strings are literals with static storage.
+    struct DeferredHeader
+    {
+        std::time_t time;
+        LogLevel level;
+        int line;
+        std::string_view file;
+        std::string_view function;
+        fmt::string_view format;
+    };
+
+    /// Arguments that can be copied into a slot as raw bytes and formatted later on the writer thread
+    template <typename... Args>
+    static constexpr bool Deferrable = (std::is_arithmetic_v<std::decay_t<Args>> && ...) &&
+                                       sizeof(DeferredHeader) + (std::size_t{0} + ... + sizeof(std::decay_t<Args>)) <=
+                                           sizeof(Entry::data);
+
+    std::atomic<LogLevel> currentLevel{LogLevel::DEBUG};
+    int logFd = -1;
+    MpscRingBuffer<Entry> queue{QueueCapacity};
+    std::atomic<OverflowPolicy> overflowPolicy{OverflowPolicy::CountAndDrop};
+    std::atomic<bool> deferFormatting{false};
+    std::atomic<std::chrono::milliseconds::rep> flushIntervalMs{50};
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> batches{0};
+    // Only the worker waits on this, producers only take the lock to wake it, once per burst
+    std::mutex workerMutex;
     std::condition_variable condition;
-    std::queue<std::string> messageQueue;
+    /// Set by the producer that takes the queue past half full, cleared by the writer before it drains
+    std::atomic<bool> wakeRequested{false};
     std::thread worker;
     std::atomic<bool> running;
     std::string currentLogDate;
@@ -59,26 +150,188 @@ public:
 
     static LogService &getInstance();
     void setLevel(LogLevel level);
-    void log(const std::string &message,
-             LogLevel level,
-             const std::string &file,
-             int line,
-             const std::string &function);
+
+    /// Whether messages of this level pass the runtime filter
+    bool isEnabled(LogLevel level) const noexcept
+    {
+        return level >= currentLevel.load(std::memory_order_relaxed);
+    }
+
+    void setOverflowPolicy(OverflowPolicy policy);
+    void setDeferredFormatting(bool enabled);
+    void setFlushInterval(std::chrono::milliseconds interval);
+    Stats stats() const;
+    void log(std::string_view message, LogLevel level, std::string_view file, int line, std::string_view function);
+
+    /**
+     * @brief Log a message built from a format string and arguments.
+     * With deferred formatting enabled and only arithmetic arguments, the arguments are copied into the queue
+     * as they are and the message is formatted on the writer thread.
+     */
+    template <typename... Args>
+    void logf(LogLevel level,
+              std::string_view file,
+              int line,
+              std::string_view function,
+              fmt::format_string<Args...> format,
+              Args &&...args)
+    {
+        if (!isEnabled(level))
+            return;
+
+        if constexpr (Deferrable<Args...>)
+        {
+            if (deferFormatting.load(std::memory_order_relaxed))
+            {
+                DeferredHeader header{std::time(nullptr), level, line, file, function, fmt::string_view(format)};
+                push([&header, &args...](Entry &slot) {
+                    slot.formatter = &formatDeferred<std::decay_t<Args>...>;
+                    auto out = slot.data;
+                    std::memcpy(out, &header, sizeof(header));
+                    out += sizeof(header);
+                    ((std::memcpy(out, &args, sizeof(args)), out += sizeof(args)), ...);
+                    slot.size = static_cast<std::uint32_t>(out - slot.data);
+                });
+                return;
+            }
+        }
+
+        fmt::basic_memory_buffer<char, 256> message;
+        fmt::format_to(fmt::appender(message), format, std::forward<Args>(args)...);
+        log(std::string_view(message.data(), message.size()), level, file, line, function);
+    }
 
 private:
     std::string getCurrentDate();
     void openLogFile();
     void processMessages();
-    std::string logLevelToString(LogLevel level);
+    void writeBatch(std::string &batch);
+    static std::string_view logLevelToString(LogLevel level);
+    static std::size_t encodeLine(char *out,
+                                  std::size_t capacity,
+                                  std::time_t time,
+                                  LogLevel level,
+                                  std::string_view file,
+                                  int line,
+                                  std::string_view function,
+                                  std::string_view message);
+
+    /**
+     * @brief Claim a queue slot and fill it, applying the overflow policy if the queue is full.
+     */
+    template <typename Fill>
+    void push(Fill &&fill)
+    {
+        if (queue.tryPush(fill))
+        {
+            // The writer sleeps for up to a flush interval when idle, wake it early if a burst is filling the queue.
+            // Concurrent producers can step over any exact size, so the first one at or past half full wakes it.
+            if (queue.size() >= QueueCapacity / 2 && !wakeRequested.load(std::memory_order_relaxed) &&
+                !wakeRequested.exchange(true, std::memory_order_acq_rel))
+                wakeWriter();
+            return;
+        }
+
+        if (overflowPolicy.load(std::memory_order_relaxed) != OverflowPolicy::Block)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        wakeWriter();
+        while (!queue.tryPush(fill))
+            std::this_thread::yield();
+    }
+
+    void wakeWriter()
+    {
+        wakeRequested.store(true, std::memory_order_release);
+        // Taking the lock orders the flag before the writer's predicate check, so the notification cannot be lost
+        {
+            std::lock_guard<std::mutex> lock(workerMutex);
+        }
+        condition.notify_one();
+    }
+
+    template <typename T>
+    static T readArgument(const char *&in)
+    {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+
+    /**
+     * @brief Format a deferred entry on the writer thread and append the log line to out.
+     */
+    template <typename... Args>
+    static void formatDeferred(const Entry &entry, std::string &out)
+    {
+        DeferredHeader header;
+        std::memcpy(&header, entry.data, sizeof(header));
+        const char *in = entry.data + sizeof(header);
+        // Braced initialisation reads the arguments in order
+        std::tuple<Args...> args{readArgument<Args>(in)...};
+
+        fmt::basic_memory_buffer<char, 256> message;
+        std::apply(
+            [&](const Args &...values) {
+                fmt::vformat_to(fmt::appender(message), header.format, fmt::make_format_args(values...));
+            },
+            args);
+
+        char line[EntrySize];
+        auto size = encodeLine(line,
+                               sizeof(line),
+                               header.time,
+                               header.level,
+                               header.file,
+                               header.line,
+                               header.function,
+                               std::string_view(message.data(), message.size()));
+        out.append(line, size);
+    }
 };
 
-static std::unique_ptr<LogService> instance;
-static std::mutex instanceMutex;
+/// File name of the calling source file, stripped of its directory at compile time
+#define LOG_FILE_NAME                                                                                                  \
+    ([] {                                                                                                              \
+        constexpr auto name = LogService::Basename(__FILE__);                                                          \
+        return name;                                                                                                   \
+    }())
 
 /**
  * @brief Macro for logging messages with the given log level.
  * The message is logged with the file, line and function where the macro is called.
+ * Calls below the compile time minimum level are removed, and the message expression is only evaluated
+ * if the level passes the runtime filter.
+ */
+#define LOG(level, message)                                                                                            \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr ((level) >= LogService::CompiledMinLevel())                                                       \
+        {                                                                                                              \
+            auto &logService_ = LogService::getInstance();                                                             \
+            if (logService_.isEnabled(level))                                                                          \
+                logService_.log(message, level, LOG_FILE_NAME, __LINE__, __FUNCTION__);                                \
+        }                                                                                                              \
+    } while (false)
+
+/**
+ * @brief Macro for logging a message built from a fmt format string and arguments, e.g.
+ * LOGF(LogService::LogLevel::ERROR, "{0}: {1}", what, ec.message()).
+ * Like LOG, but the message is only formatted if the level passes both filters.
  */
-#define LOG(level, message) LogService::getInstance().log(message, level, __FILE__, __LINE__, __FUNCTION__)
+#define LOGF(level, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr ((level) >= LogService::CompiledMinLevel())                                                       \
+        {                                                                                                              \
+            auto &logService_ = LogService::getInstance();                                                             \
+            if (logService_.isEnabled(level))                                                                          \
+                logService_.logf(level, LOG_FILE_NAME, __LINE__, __FUNCTION__, __VA_ARGS__);                           \
+        }                                                                                                              \
+    } while (false)
 
 #endif // LOGSERVICE_HPP
@@ -0,0 +1,247 @@
+#include "Metrics.h"
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace
+{
+void appendEscaped(std::string &out, std::string_view text, bool quotes)
+{
+    for (auto c : text)
+    {
+        if (c == '\\')
+            out += "\\\\";
+        else if (c == '\n')
+            out += "\\n";
+        else if (c == '"' && quotes)
+            out += "\\\"";
+        else
+            out += c;
+    }
+}
+
+/// Render labels as {a="1",b="2"}, with an optional extra label such as a histogram's le
+void appendLabels(std::string &out,
+                  const MetricLabels &labels,
+                  std::string_view extraName = {},
+                  std::string_view extraValue = {})
+{
+    if (labels.empty() && extraName.empty())
+        return;
+
+    out += '{';
+    auto first = true;
+    auto append = [&](std::string_view name, std::string_view value)
+    {
+        if (!first)
+            out += ',';
+        first = false;
+        out += name;
+        out += "=\"";
+        appendEscaped(out, value, true);
+        out += '"';
+    };
+    for (const auto &[name, value] : labels)
+        append(name, value);
+    if (!extraName.empty())
+        append(extraName, extraValue);
+    out += '}';
+}
+
+std::string_view typeName(MetricType type)
+{
+    switch (type)
+    {
+    case MetricType::Counter:
+        return "counter";
+    case MetricType::Gauge:
+        return "gauge";
+    case MetricType::Histogram:
+        return "histogram";
+    }
+    return "untyped";
+}
+
+double seconds(std::uint64_t nanoseconds)
+{
+    return static_cast<double>(nanoseconds) / 1e9;
+}
+} // namespace
+
+Histogram::Snapshot Histogram::snapshot() const noexcept
+{
+    Snapshot result{};
+    for (const auto &shard : shards)
+    {
+        for (std::size_t i = 0; i < BucketCount; ++i)
+        {
+            auto count = shard.buckets[i].load(std::memory_order_relaxed);
+            result.buckets[i] += count;
+            result.count += count;
+        }
+        result.sumNanoseconds += shard.sum.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+MetricsRegistry &MetricsRegistry::getInstance()
+{
+    static MetricsRegistry instance;
+    return instance;
+}
+
+MetricsRegistry::Family &MetricsRegistry::findFamily(std::string_view name, std::string_view help, MetricType type)
+{
+    auto family = families.find(name);
+    if (family == families.end())
+        family = families.emplace(std::string(name), Family{std::string(help), type, {}, nullptr}).first;
+    else if (family->second.type != type)
+        throw std::invalid_argument("Metric " + std::string(name) + " is already registered with another type");
+    return family->second;
+}
+
+MetricsRegistry::Series &MetricsRegistry::find(std::string_view name,
+                                               std::string_view help,
+                                               MetricType type,
+                                               MetricLabels &&labels)
+{
+    auto &family = findFamily(name, help, type);
+    for (auto &series : family.series)
+    {
+        if (series.labels == labels)
+            return series;
+    }
+    family.series.push_back(Series{std::move(labels), nullptr, nullptr, nullptr, nullptr});
+    return family.series.back();
+}
+
+Counter &MetricsRegistry::counter(std::string_view name, std::string_view help, MetricLabels labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &series = find(name, help, MetricType::Counter, std::move(labels));
+    if (!series.counter)
+        series.counter = std::make_unique<Counter>();
+    return *series.counter;
+}
+
+Gauge &MetricsRegistry::gauge(std::string_view name, std::string_view help, MetricLabels labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &series = find(name, help, MetricType::Gauge, std::move(labels));
+    if (!series.gauge)
+        series.gauge = std::make_unique<Gauge>();
+    return *series.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(std::string_view name, std::string_view help, MetricLabels labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &series = find(name, help, MetricType::Histogram, std::move(labels));
+    if (!series.histogram)
+        series.histogram = std::make_unique<Histogram>();
+    return *series.histogram;
+}
+
+void MetricsRegistry::callback(std::string_view name,
+                               std::string_view help,
+                               MetricType type,
+                               MetricLabels labels,
+                               std::function<double()> read)
+{
+    if (type == MetricType::Histogram)
+        throw std::invalid_argument("Histograms cannot be read through a callback");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    find(name, help, type, std::move(labels)).read = std::move(read);
+}
+
+void MetricsRegistry::collector(std::string_view name,
+                                std::string_view help,
+                                MetricType type,
+                                std::function<MetricSamples()> collect)
+{
+    if (type == MetricType::Histogram)
+        throw std::invalid_argument("Histograms cannot be read through a collector");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    findFamily(name, help, type).collect = std::move(collect);
+}
+
+/**
+     * @brief Render every metric. Histograms list one bucket per power of two, which keeps the output short while
+     * the counts stay exact, since the buckets are cumulative.
+     */
+std::string MetricsRegistry::render() const
+{
+    std::string out;
+    out.reserve(16 * 1024);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &[name, family] : families)
+    {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        appendEscaped(out, family.help, false);
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += typeName(family.type);
+        out += '\n';
+
+        for (const auto &series : family.series)
+        {
+            if (series.histogram)
+            {
+                auto snapshot = series.histogram->snapshot();
+                std::uint64_t cumulative = 0;
+                for (std::size_t i = 0; i + 1 < Histogram::BucketCount; ++i)
+                {
+                    cumulative += snapshot.buckets[i];
+                    if (i != 0 && i % Histogram::SubBuckets != 0)
+                        continue;
+
+                    out += name;
+                    out += "_bucket";
+                    appendLabels(out, series.labels, "le", fmt::format("{}", seconds(Histogram::upperBound(i))));
+                    fmt::format_to(std::back_inserter(out), " {}\n", cumulative);
+                }
+                out += name;
+                out += "_bucket";
+                appendLabels(out, series.labels, "le", "+Inf");
+                fmt::format_to(std::back_inserter(out), " {}\n", snapshot.count);
+
+                out += name;
+                out += "_sum";
+                appendLabels(out, series.labels);
+                fmt::format_to(std::back_inserter(out), " {}\n", seconds(snapshot.sumNanoseconds));
+                out += name;
+                out += "_count";
+                appendLabels(out, series.labels);
+                fmt::format_to(std::back_inserter(out), " {}\n", snapshot.count);
+                continue;
+            }
+
+            out += name;
+            appendLabels(out, series.labels);
+            if (series.counter)
+                fmt::format_to(std::back_inserter(out), " {}\n", series.counter->value());
+            else if (series.gauge)
+                fmt::format_to(std::back_inserter(out), " {}\n", series.gauge->value());
+            else if (series.read)
+                fmt::format_to(std::back_inserter(out), " {}\n", series.read());
+            else
+                out += " 0\n";
+        }
+
+        if (family.collect)
+        {
+            for (const auto &[labels, value] : family.collect())
+            {
+                out += name;
+                appendLabels(out, labels);
+                fmt::format_to(std::back_inserter(out), " {}\n", value);
+            }
+        }
+    }
+    return out;
+}
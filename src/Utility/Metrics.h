@@ -0,0 +1,250 @@
+/**
+ * @file Metrics.h
+ * @author Frederik Pedersen
+ * @brief Counters, gauges and latency histograms, rendered in the Prometheus text format.
+ * @version 0.1
+ * @date 2024-05-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Number of cells every counter and histogram is split into
+constexpr std::size_t MetricShards = 16;
+
+/**
+ * @brief The cell the calling thread records into. Threads are handed cells round robin the first time they record,
+ * so up to MetricShards threads never write to the same cache line.
+ */
+inline std::size_t currentMetricShard() noexcept
+{
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % MetricShards;
+    return shard;
+}
+
+/**
+ * @brief Monotonic counter. Adding is one relaxed atomic increment on the calling thread's own cache line, reading
+ * sums all cells.
+ */
+class Counter
+{
+public:
+    void add(std::uint64_t amount = 1) noexcept
+    {
+        cells[currentMetricShard()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const noexcept
+    {
+        std::uint64_t total = 0;
+        for (const auto &cell : cells)
+            total += cell.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Cell
+    {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    std::array<Cell, MetricShards> cells;
+};
+
+/// Value that can go up and down, e.g. open connections
+class Gauge
+{
+public:
+    void add(std::int64_t amount = 1) noexcept
+    {
+        current.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void set(std::int64_t value) noexcept
+    {
+        current.store(value, std::memory_order_relaxed);
+    }
+
+    std::int64_t value() const noexcept
+    {
+        return current.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::int64_t> current{0};
+};
+
+/**
+ * @brief Latency histogram with fixed log-linear buckets, in the style of HdrHistogram.
+ *
+ * Every power of two between about 1 us and 69 s is split into four buckets, so a recorded value lands in a bucket
+ * at most 25% wider than itself. Finding the bucket takes a count-leading-zeros and two shifts, recording is two
+ * relaxed increments on the calling thread's own cells.
+ */
+class Histogram
+{
+public:
+    static constexpr unsigned SubBucketBits = 2;
+    static constexpr unsigned SubBuckets = 1u << SubBucketBits;
+    /// Values below 2^MinExponent ns share the first bucket
+    static constexpr unsigned MinExponent = 10;
+    /// Values from 2^MaxExponent ns on share the last bucket
+    static constexpr unsigned MaxExponent = 36;
+    static constexpr std::size_t BucketCount = 2 + (MaxExponent - MinExponent) * SubBuckets;
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, BucketCount> buckets;
+        std::uint64_t count;
+        std::uint64_t sumNanoseconds;
+    };
+
+    void record(std::chrono::nanoseconds elapsed) noexcept
+    {
+        auto ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(0, elapsed.count()));
+        auto &shard = shards[currentMetricShard()];
+        shard.buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    static std::size_t bucketFor(std::uint64_t ns) noexcept
+    {
+        if (ns < (std::uint64_t{1} << MinExponent))
+            return 0;
+
+        auto exponent = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+        if (exponent >= MaxExponent)
+            return BucketCount - 1;
+
+        auto sub = (ns >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+        return 1 + (exponent - MinExponent) * SubBuckets + sub;
+    }
+
+    /// Exclusive upper bound of a bucket in nanoseconds. The last bucket has none and returns 0.
+    static std::uint64_t upperBound(std::size_t bucket) noexcept
+    {
+        if (bucket == 0)
+            return std::uint64_t{1} << MinExponent;
+        if (bucket >= BucketCount - 1)
+            return 0;
+
+        auto exponent = MinExponent + static_cast<unsigned>((bucket - 1) / SubBuckets);
+        auto sub = (bucket - 1) % SubBuckets;
+        return (std::uint64_t{1} << exponent) + (sub + 1) * (std::uint64_t{1} << (exponent - SubBucketBits));
+    }
+
+    Snapshot snapshot() const noexcept;
+
+private:
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<std::uint64_t>, BucketCount> buckets{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::array<Shard, MetricShards> shards;
+};
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+/// Labelled values produced by a collector when the metrics are rendered
+using MetricSamples = std::vector<std::pair<MetricLabels, double>>;
+
+enum class MetricType
+{
+    Counter,
+    Gauge,
+    Histogram
+};
+
+/**
+ * @brief Process wide registry of named metrics.
+ *
+ * Metrics are registered once, typically during startup, and the references handed out stay valid for the life
+ * of the process, so recording never touches the registry or its lock. Statistics that are already kept
+ * elsewhere can be exposed with a callback that is read whenever the metrics are rendered.
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry &getInstance();
+
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry &) = delete;
+    MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+    /**
+     * @brief Get the metric with this name and labels, creating it on first use.
+     *
+     * @throws std::invalid_argument if the name is already registered with another type
+     */
+    Counter &counter(std::string_view name, std::string_view help, MetricLabels labels = {});
+    Gauge &gauge(std::string_view name, std::string_view help, MetricLabels labels = {});
+    Histogram &histogram(std::string_view name, std::string_view help, MetricLabels labels = {});
+
+    /**
+     * @brief Expose a value that is read when the metrics are rendered. Replaces an earlier callback with the same
+     * name and labels. The callback may be called from any thread.
+     */
+    void callback(std::string_view name,
+                  std::string_view help,
+                  MetricType type,
+                  MetricLabels labels,
+                  std::function<double()> read);
+
+    /**
+     * @brief Expose a family whose series are only known when the metrics are rendered, such as one per topic.
+     * Replaces an earlier collector with the same name. The collector may be called from any thread.
+     */
+    void collector(std::string_view name,
+                   std::string_view help,
+                   MetricType type,
+                   std::function<MetricSamples()> collect);
+
+    /// Render every metric in the Prometheus text exposition format, version 0.0.4
+    std::string render() const;
+
+private:
+    struct Series
+    {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> read;
+    };
+
+    struct Family
+    {
+        std::string help;
+        MetricType type;
+        std::vector<Series> series;
+        std::function<MetricSamples()> collect;
+    };
+
+    Family &findFamily(std::string_view name, std::string_view help, MetricType type);
+    Series &find(std::string_view name, std::string_view help, MetricType type, MetricLabels &&labels);
+
+    mutable std::mutex mutex;
+    std::map<std::string, Family, std::less<>> families;
+};
+
+#endif // METRICS_H
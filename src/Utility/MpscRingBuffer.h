@@ -0,0 +1,143 @@
+/**
+ * @file MpscRingBuffer.h
+ * @author Frederik Pedersen
+ * @brief Bounded lock-free queue for many producers and a single consumer.
+ * @version 0.1
+ * @date 2024-04-24
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef MPSC_RING_BUFFER_H
+#define MPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Fixed-capacity ring of preallocated slots, after Dmitry Vyukov's bounded queue.
+ *
+ * Producers claim a slot with a single compare-and-swap and fill it in place, so pushing never allocates or
+ * locks. Every slot carries a sequence number that tells the consumer when the producer has finished writing.
+ * Only one thread may consume at a time.
+ *
+ * @tparam T Slot type, default constructed once up front and reused
+ */
+template <typename T>
+class MpscRingBuffer
+{
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+     */
+    explicit MpscRingBuffer(std::size_t capacity) : mask(roundUp(capacity) - 1), cells(new Cell[mask + 1])
+    {
+        for (std::size_t i = 0; i <= mask; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRingBuffer(const MpscRingBuffer &) = delete;
+    MpscRingBuffer &operator=(const MpscRingBuffer &) = delete;
+
+    /**
+     * @brief Claim a slot and fill it in place.
+     *
+     * @param fill Callable taking T&, must not throw
+     * @return false if the ring is full
+     */
+    template <typename Fill>
+    bool tryPush(Fill &&fill)
+    {
+        auto pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            auto seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Hand published slots to consume in order and release them. Consumer thread only.
+     *
+     * @param consume Callable taking const T&
+     * @param maxCount Stop after this many slots
+     * @return The number of slots consumed
+     */
+    template <typename Consume>
+    std::size_t drain(Consume &&consume, std::size_t maxCount = SIZE_MAX)
+    {
+        std::size_t count = 0;
+        auto pos = dequeuePos.load(std::memory_order_relaxed);
+        while (count < maxCount)
+        {
+            auto &cell = cells[pos & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+                break;
+
+            consume(static_cast<const T &>(cell.value));
+            cell.sequence.store(pos + mask + 1, std::memory_order_release);
+            ++pos;
+            ++count;
+        }
+        dequeuePos.store(pos, std::memory_order_relaxed);
+        return count;
+    }
+
+    /// Approximate number of claimed slots, including ones still being written
+    std::size_t size() const noexcept
+    {
+        auto tail = dequeuePos.load(std::memory_order_relaxed);
+        auto head = enqueuePos.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value{};
+    };
+
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t size = 2;
+        while (size < n)
+            size <<= 1;
+        return size;
+    }
+
+    const std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    // Producers and the consumer update different counters, so keep them on separate cache lines
+    alignas(64) std::atomic<std::size_t> enqueuePos{0};
+    alignas(64) std::atomic<std::size_t> dequeuePos{0};
+};
+
+#endif // MPSC_RING_BUFFER_H
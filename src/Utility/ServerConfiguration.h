@@ -0,0 +1,289 @@
+/**
+ * @file ServerConfiguration.h
+ * @author Frederik Pedersen
+ * @brief Runtime settings for the API server, read from the command line.
+ * @version 0.1
+ * @date 2024-04-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef SERVER_CONFIGURATION_H
+#define SERVER_CONFIGURATION_H
+
+#include <algorithm>
+#include <charconv>
+#include <config.hpp>
+#include <cstddef>
+#include <cxxopts.hpp>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Body limit for one route, replacing the one its controller registered it with
+struct RouteBodyLimit
+{
+    std::string method;
+    std::string path;
+    std::size_t bytes = 0;
+};
+
+struct ServerConfiguration
+{
+    std::string address = std::string(server_address);
+    unsigned short port = 8080;
+    std::string docRoot = std::string(doc_root);
+
+    /// Number of network threads
+    int threads = 4;
+    /// Give every thread its own io_context and SO_REUSEPORT acceptor instead of sharing one io_context
+    bool reusePort = false;
+    /// Pin network thread i to CPU i
+    bool pinThreads = false;
+
+    /// HTTP requests a connection may have read but not yet answered
+    std::size_t httpPipelineDepth = 8;
+    /// Seconds to receive the header of a request
+    int httpHeaderTimeout = 10;
+    /// Seconds to receive the body of a request
+    int httpBodyTimeout = 30;
+    /// Seconds a keep-alive connection may wait for the next request
+    int httpIdleTimeout = 30;
+    /// Seconds to write one response
+    int httpWriteTimeout = 30;
+    /// Largest request header in bytes
+    std::size_t httpHeaderLimit = 8 * 1024;
+    /// Largest request body in bytes, unless the route sets its own limit
+    std::size_t httpBodyLimit = 10000;
+    /// Per route body limits given as METHOD:/path=bytes
+    std::vector<RouteBodyLimit> httpRouteBodyLimits;
+    /// Requests served on one connection before it is closed, 0 for no limit
+    std::size_t httpMaxRequests = 1000;
+
+    /// Serve files from docRoot for GET and HEAD requests that match no route
+    bool staticFiles = true;
+    /// Static files kept open between requests
+    std::size_t staticCacheEntries = 256;
+    /// Static files up to this many KiB are kept in memory
+    std::size_t staticSmallFileKiB = 64;
+    /// Seconds a cached static file is served before checking for a newer version
+    int staticRevalidate = 2;
+
+    /// Expose Prometheus metrics at /metrics
+    bool metrics = true;
+    /// File request traces are appended to as OTLP/JSON, tracing is off if empty
+    std::string traceFile;
+    /// Share of requests without a traceparent header that are traced
+    double traceSampleRatio = 0.01;
+
+    /// What log calls do when the log queue is full: drop, block or count-and-drop
+    std::string logOverflow = "count-and-drop";
+    /// Milliseconds a log message may wait before it is written to the file
+    int logFlushMs = 50;
+    /// Format log calls with only arithmetic arguments on the writer thread instead of the caller
+    bool logDeferredFormat = false;
+
+    /// Threads hashing passwords with Argon2, further limited by hashMemoryMiB
+    int hashThreads = 4;
+    /// Memory the Argon2 threads may use together
+    std::size_t hashMemoryMiB = 256;
+    /// Hashes that may wait for a thread before requests are answered with 503, 0 to accept only while one is free
+    std::size_t hashQueue = 64;
+
+    /// Database connections that may be open at once, 0 for no limit
+    std::size_t dbMaxConnections = 16;
+    /// Idle database connections kept open between requests
+    std::size_t dbMinConnections = 4;
+    /// Check pooled database connections before handing them out
+    bool dbPing = true;
+    /// Keep users in process memory instead of the database, for load tests. Users are lost on exit.
+    bool inMemoryUsers = false;
+
+    /// Users cached by username, 0 to disable the cache
+    std::size_t userCacheSize = 10000;
+    /// Seconds a found user stays cached
+    int userCacheTtl = 60;
+    /// Seconds an unknown username stays cached
+    int userCacheNegativeTtl = 5;
+
+    /// Outbound messages that may wait per websocket session
+    std::size_t wsQueueMessages = 1024;
+    /// Waiting KiB per websocket session at which the slow consumer policy applies
+    std::size_t wsQueueHighWatermarkKiB = 4096;
+    /// Waiting KiB per websocket session that drop-oldest trims down to
+    std::size_t wsQueueLowWatermarkKiB = 1024;
+    /// drop-oldest, coalesce or disconnect
+    std::string wsSlowConsumerPolicy = "drop-oldest";
+
+    /// Offer permessage-deflate to websocket clients
+    bool wsDeflate = true;
+    /// LZ77 window for websocket compression, 9 to 15
+    int wsDeflateWindowBits = 15;
+    /// zlib level for websocket compression, 0 to 9
+    int wsDeflateLevel = 6;
+    /// Websocket messages smaller than this many bytes are sent uncompressed
+    std::size_t wsDeflateMinSize = 256;
+    /// Keep the compression dictionary between websocket messages
+    bool wsDeflateContextTakeover = true;
+
+    /**
+     * @brief Parse the command line. Compile time settings from config.hpp are used as defaults.
+     *
+     * @param argc Argument count from main
+     * @param argv Argument vector from main
+     * @return The configuration, or std::nullopt if only the help text was requested
+     * @throws cxxopts::exceptions::exception if the arguments cannot be parsed
+     * @throws std::invalid_argument if an option has an unknown value
+     */
+    static std::optional<ServerConfiguration> FromCommandLine(int argc, char *argv[])
+    {
+        ServerConfiguration config;
+        if (!server_port.empty())
+            config.port = static_cast<unsigned short>(std::stoi(std::string(server_port)));
+
+        cxxopts::Options options(std::string(project_name), "ccfolio API server");
+        // clang-format off
+        options.add_options()
+            ("a,address", "Address to listen on", cxxopts::value<std::string>()->default_value(config.address))
+            ("p,port", "Port to listen on", cxxopts::value<unsigned short>()->default_value(std::to_string(config.port)))
+            ("doc-root", "Directory to serve static files from", cxxopts::value<std::string>()->default_value(config.docRoot))
+            ("t,threads", "Number of network threads", cxxopts::value<int>()->default_value(std::to_string(config.threads)))
+            ("reuse-port", "Run one io_context and SO_REUSEPORT acceptor per thread", cxxopts::value<bool>()->default_value("false"))
+            ("pin-threads", "Pin each network thread to its own CPU", cxxopts::value<bool>()->default_value("false"))
+            ("http-pipeline-depth", "HTTP requests per connection that may wait for their response", cxxopts::value<std::size_t>()->default_value(std::to_string(config.httpPipelineDepth)))
+            ("http-header-timeout", "Seconds to receive the header of a request", cxxopts::value<int>()->default_value(std::to_string(config.httpHeaderTimeout)))
+            ("http-body-timeout", "Seconds to receive the body of a request", cxxopts::value<int>()->default_value(std::to_string(config.httpBodyTimeout)))
+            ("http-idle-timeout", "Seconds a keep-alive connection may wait for the next request", cxxopts::value<int>()->default_value(std::to_string(config.httpIdleTimeout)))
+            ("http-write-timeout", "Seconds to write one response", cxxopts::value<int>()->default_value(std::to_string(config.httpWriteTimeout)))
+            ("http-header-limit", "Largest request header in bytes", cxxopts::value<std::size_t>()->default_value(std::to_string(config.httpHeaderLimit)))
+            ("http-body-limit", "Largest request body in bytes, unless the route sets its own", cxxopts::value<std::size_t>()->default_value(std::to_string(config.httpBodyLimit)))
+            ("http-route-body-limit", "Largest request body for one route as METHOD:/path=bytes, may be repeated", cxxopts::value<std::vector<std::string>>())
+            ("http-max-requests", "Requests served on one connection before it is closed, 0 for no limit", cxxopts::value<std::size_t>()->default_value(std::to_string(config.httpMaxRequests)))
+            ("static-files", "Serve files from doc-root for GET and HEAD requests that match no route", cxxopts::value<bool>()->default_value(config.staticFiles ? "true" : "false"))
+            ("static-cache-entries", "Static files kept open between requests", cxxopts::value<std::size_t>()->default_value(std::to_string(config.staticCacheEntries)))
+            ("static-small-file", "Static files up to this many KiB are kept in memory", cxxopts::value<std::size_t>()->default_value(std::to_string(config.staticSmallFileKiB)))
+            ("static-revalidate", "Seconds a cached static file is served before checking for a newer version", cxxopts::value<int>()->default_value(std::to_string(config.staticRevalidate)))
+            ("metrics", "Expose Prometheus metrics at /metrics", cxxopts::value<bool>()->default_value(config.metrics ? "true" : "false"))
+            ("trace-file", "Append request traces to this file as OTLP/JSON, tracing is off if empty", cxxopts::value<std::string>()->default_value(config.traceFile))
+            ("trace-sample-ratio", "Share of requests without a traceparent header that are traced", cxxopts::value<double>()->default_value(std::to_string(config.traceSampleRatio)))
+            ("log-overflow", "Full log queue policy: drop, block or count-and-drop", cxxopts::value<std::string>()->default_value(config.logOverflow))
+            ("log-flush-ms", "Milliseconds a log message may wait before it is written", cxxopts::value<int>()->default_value(std::to_string(config.logFlushMs)))
+            ("log-deferred-format", "Format log messages with numeric arguments on the writer thread", cxxopts::value<bool>()->default_value(config.logDeferredFormat ? "true" : "false"))
+            ("hash-threads", "Number of password hashing threads", cxxopts::value<int>()->default_value(std::to_string(config.hashThreads)))
+            ("hash-memory", "Memory budget for password hashing in MiB", cxxopts::value<std::size_t>()->default_value(std::to_string(config.hashMemoryMiB)))
+            ("hash-queue", "Password hashes that may wait for a thread before requests are refused, 0 to accept only while a thread is free", cxxopts::value<std::size_t>()->default_value(std::to_string(config.hashQueue)))
+            ("db-max-connections", "Database connections that may be open at once, 0 for no limit", cxxopts::value<std::size_t>()->default_value(std::to_string(config.dbMaxConnections)))
+            ("db-min-connections", "Idle database connections kept open", cxxopts::value<std::size_t>()->default_value(std::to_string(config.dbMinConnections)))
+            ("db-ping", "Check pooled database connections before use", cxxopts::value<bool>()->default_value(config.dbPing ? "true" : "false"))
+            ("in-memory-users", "Keep users in memory instead of the database, for load tests", cxxopts::value<bool>()->default_value(config.inMemoryUsers ? "true" : "false"))
+            ("user-cache-size", "Users cached by username, 0 to disable", cxxopts::value<std::size_t>()->default_value(std::to_string(config.userCacheSize)))
+            ("user-cache-ttl", "Seconds a found user stays cached", cxxopts::value<int>()->default_value(std::to_string(config.userCacheTtl)))
+            ("user-cache-negative-ttl", "Seconds an unknown username stays cached", cxxopts::value<int>()->default_value(std::to_string(config.userCacheNegativeTtl)))
+            ("ws-queue-messages", "Outbound messages that may wait per websocket session", cxxopts::value<std::size_t>()->default_value(std::to_string(config.wsQueueMessages)))
+            ("ws-queue-high-watermark", "Waiting KiB per websocket session before the slow consumer policy applies", cxxopts::value<std::size_t>()->default_value(std::to_string(config.wsQueueHighWatermarkKiB)))
+            ("ws-queue-low-watermark", "Waiting KiB per websocket session that drop-oldest trims down to", cxxopts::value<std::size_t>()->default_value(std::to_string(config.wsQueueLowWatermarkKiB)))
+            ("ws-slow-consumer", "Slow websocket client policy: drop-oldest, coalesce or disconnect", cxxopts::value<std::string>()->default_value(config.wsSlowConsumerPolicy))
+            ("ws-deflate", "Offer permessage-deflate to websocket clients", cxxopts::value<bool>()->default_value(config.wsDeflate ? "true" : "false"))
+            ("no-ws-deflate", "Do not offer permessage-deflate, same as --ws-deflate=false", cxxopts::value<bool>()->default_value("false"))
+            ("ws-deflate-window-bits", "LZ77 window bits for websocket compression, 9 to 15", cxxopts::value<int>()->default_value(std::to_string(config.wsDeflateWindowBits)))
+            ("ws-deflate-level", "zlib level for websocket compression, 0 to 9", cxxopts::value<int>()->default_value(std::to_string(config.wsDeflateLevel)))
+            ("ws-deflate-min-size", "Websocket messages smaller than this many bytes are not compressed", cxxopts::value<std::size_t>()->default_value(std::to_string(config.wsDeflateMinSize)))
+            ("ws-deflate-context-takeover", "Keep the compression dictionary between websocket messages", cxxopts::value<bool>()->default_value(config.wsDeflateContextTakeover ? "true" : "false"))
+            ("h,help", "Print usage");
+        // clang-format on
+
+        auto result = options.parse(argc, argv);
+        if (result.count("help"))
+        {
+            std::cout << options.help() << std::endl;
+            return std::nullopt;
+        }
+
+        config.address = result["address"].as<std::string>();
+        config.port = result["port"].as<unsigned short>();
+        config.docRoot = result["doc-root"].as<std::string>();
+        config.threads = std::max(1, result["threads"].as<int>());
+        config.reusePort = result["reuse-port"].as<bool>();
+        config.pinThreads = result["pin-threads"].as<bool>();
+        config.httpPipelineDepth = std::max<std::size_t>(1, result["http-pipeline-depth"].as<std::size_t>());
+        config.httpHeaderTimeout = std::max(1, result["http-header-timeout"].as<int>());
+        config.httpBodyTimeout = std::max(1, result["http-body-timeout"].as<int>());
+        config.httpIdleTimeout = std::max(1, result["http-idle-timeout"].as<int>());
+        config.httpWriteTimeout = std::max(1, result["http-write-timeout"].as<int>());
+        config.httpHeaderLimit = std::max<std::size_t>(1024, result["http-header-limit"].as<std::size_t>());
+        config.httpBodyLimit = result["http-body-limit"].as<std::size_t>();
+        if (result.count("http-route-body-limit"))
+        {
+            for (auto const &limit : result["http-route-body-limit"].as<std::vector<std::string>>())
+                config.httpRouteBodyLimits.push_back(ParseRouteBodyLimit(limit));
+        }
+        config.httpMaxRequests = result["http-max-requests"].as<std::size_t>();
+        config.staticFiles = result["static-files"].as<bool>();
+        config.staticCacheEntries = std::max<std::size_t>(1, result["static-cache-entries"].as<std::size_t>());
+        config.staticSmallFileKiB = result["static-small-file"].as<std::size_t>();
+        config.staticRevalidate = std::max(0, result["static-revalidate"].as<int>());
+        config.metrics = result["metrics"].as<bool>();
+        config.traceFile = result["trace-file"].as<std::string>();
+        config.traceSampleRatio = std::clamp(result["trace-sample-ratio"].as<double>(), 0.0, 1.0);
+        config.logOverflow = result["log-overflow"].as<std::string>();
+        if (config.logOverflow != "drop" && config.logOverflow != "block" && config.logOverflow != "count-and-drop")
+            throw std::invalid_argument("log-overflow must be drop, block or count-and-drop");
+        config.logFlushMs = std::max(1, result["log-flush-ms"].as<int>());
+        config.logDeferredFormat = result["log-deferred-format"].as<bool>();
+        config.hashThreads = std::max(1, result["hash-threads"].as<int>());
+        config.hashMemoryMiB = result["hash-memory"].as<std::size_t>();
+        config.hashQueue = result["hash-queue"].as<std::size_t>();
+        config.dbMaxConnections = result["db-max-connections"].as<std::size_t>();
+        config.dbMinConnections = result["db-min-connections"].as<std::size_t>();
+        config.dbPing = result["db-ping"].as<bool>();
+        config.inMemoryUsers = result["in-memory-users"].as<bool>();
+        config.userCacheSize = result["user-cache-size"].as<std::size_t>();
+        config.userCacheTtl = std::max(0, result["user-cache-ttl"].as<int>());
+        config.userCacheNegativeTtl = std::max(0, result["user-cache-negative-ttl"].as<int>());
+        config.wsQueueMessages = std::max<std::size_t>(1, result["ws-queue-messages"].as<std::size_t>());
+        config.wsQueueHighWatermarkKiB = result["ws-queue-high-watermark"].as<std::size_t>();
+        config.wsQueueLowWatermarkKiB =
+            std::min(config.wsQueueHighWatermarkKiB, result["ws-queue-low-watermark"].as<std::size_t>());
+        config.wsSlowConsumerPolicy = result["ws-slow-consumer"].as<std::string>();
+        if (config.wsSlowConsumerPolicy != "drop-oldest" && config.wsSlowConsumerPolicy != "coalesce" &&
+            config.wsSlowConsumerPolicy != "disconnect")
+            throw std::invalid_argument("ws-slow-consumer must be drop-oldest, coalesce or disconnect");
+        config.wsDeflate = result["ws-deflate"].as<bool>() && !result["no-ws-deflate"].as<bool>();
+        config.wsDeflateWindowBits = std::clamp(result["ws-deflate-window-bits"].as<int>(), 9, 15);
+        config.wsDeflateLevel = std::clamp(result["ws-deflate-level"].as<int>(), 0, 9);
+        config.wsDeflateMinSize = result["ws-deflate-min-size"].as<std::size_t>();
+        config.wsDeflateContextTakeover = result["ws-deflate-context-takeover"].as<bool>();
+        return config;
+    }
+
+private:
+    /**
+     * @brief Parse a route body limit of the form METHOD:/path=bytes, e.g. POST:/user/login=2048
+     *
+     * @throws std::invalid_argument if the limit is malformed
+     */
+    static RouteBodyLimit ParseRouteBodyLimit(const std::string &text)
+    {
+        RouteBodyLimit limit;
+        auto colon = text.find(':');
+        auto equals = text.rfind('=');
+        if (colon != std::string::npos && colon > 0 && equals != std::string::npos && equals > colon + 1 &&
+            text[colon + 1] == '/')
+        {
+            auto end = text.data() + text.size();
+            auto [last, ec] = std::from_chars(text.data() + equals + 1, end, limit.bytes);
+            if (ec == std::errc() && last == end)
+            {
+                limit.method = text.substr(0, colon);
+                limit.path = text.substr(colon + 1, equals - colon - 1);
+                return limit;
+            }
+        }
+        throw std::invalid_argument("http-route-body-limit must look like METHOD:/path=bytes, not " + text);
+    }
+};
+
+#endif // SERVER_CONFIGURATION_H
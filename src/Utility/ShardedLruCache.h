@@ -0,0 +1,223 @@
+/**
+ * @file ShardedLruCache.h
+ * @author Frederik Pedersen
+ * @brief Bounded, thread safe LRU cache with per-entry expiry.
+ * @version 0.1
+ * @date 2024-04-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef SHARDED_LRU_CACHE_H
+#define SHARDED_LRU_CACHE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * @brief LRU cache split into independently locked shards.
+ * Keys are spread over the shards by hash, so concurrent lookups of different keys rarely contend.
+ * Every entry carries its own expiry time and is dropped on the first lookup after it expires.
+ * Each shard holds at most capacity / shardCount entries and evicts its least recently used entry when full.
+ *
+ * @tparam Key Key type
+ * @tparam Value Value type, copied out on lookup, so large values should be held by pointer
+ * @tparam Hash Hash function for Key
+ * @tparam Clock Clock the expiry times are measured on
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Clock = std::chrono::steady_clock>
+class ShardedLruCache
+{
+public:
+    using TimePoint = typename Clock::time_point;
+
+    struct Stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t insertions;
+        std::uint64_t evictions;
+        std::uint64_t expirations;
+        std::size_t size;
+    };
+
+    explicit ShardedLruCache(std::size_t capacity, std::size_t shardCount = 16)
+        : shardCount_(std::max<std::size_t>(1, shardCount)), shards_(new Shard[shardCount_])
+    {
+        auto perShard = std::max<std::size_t>(1, capacity / shardCount_);
+        for (std::size_t i = 0; i < shardCount_; ++i)
+            shards_[i].capacity = perShard;
+    }
+
+    /**
+     * @brief Look up a key and mark it as recently used.
+     *
+     * @param key The key to look up
+     * @return The cached value, or std::nullopt if it is missing or expired
+     */
+    std::optional<Value> get(const Key &key)
+    {
+        auto &shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+        {
+            ++shard.stats.misses;
+            return std::nullopt;
+        }
+
+        if (it->second->expiresAt <= Clock::now())
+        {
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+            ++shard.stats.expirations;
+            ++shard.stats.misses;
+            return std::nullopt;
+        }
+
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        ++shard.stats.hits;
+        return it->second->value;
+    }
+
+    /**
+     * @brief Insert or replace a value. Entries that are already expired are not stored.
+     *
+     * @param key The key
+     * @param value The value
+     * @param expiresAt When the entry stops being served
+     */
+    void put(const Key &key, Value value, TimePoint expiresAt)
+    {
+        if (expiresAt <= Clock::now())
+            return;
+
+        auto &shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            it->second->value = std::move(value);
+            it->second->expiresAt = expiresAt;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+
+        if (shard.index.size() >= shard.capacity)
+        {
+            shard.index.erase(shard.entries.back().key);
+            shard.entries.pop_back();
+            ++shard.stats.evictions;
+        }
+
+        shard.entries.push_front(Entry{key, std::move(value), expiresAt});
+        shard.index.emplace(key, shard.entries.begin());
+        ++shard.stats.insertions;
+    }
+
+    /**
+     * @brief Put a value that expires a fixed time from now.
+     */
+    void put(const Key &key, Value value, typename Clock::duration ttl)
+    {
+        put(key, std::move(value), Clock::now() + ttl);
+    }
+
+    /**
+     * @brief Remove a key.
+     *
+     * @return true if the key was cached
+     */
+    bool erase(const Key &key)
+    {
+        auto &shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+            return false;
+
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+        return true;
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < shardCount_; ++i)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            shards_[i].index.clear();
+            shards_[i].entries.clear();
+        }
+    }
+
+    std::size_t size() const
+    {
+        return stats().size;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return shards_[0].capacity * shardCount_;
+    }
+
+    /**
+     * @brief Sum the counters of all shards. Each shard is locked in turn, so the totals are not a single snapshot.
+     */
+    Stats stats() const
+    {
+        Stats total{};
+        for (std::size_t i = 0; i < shardCount_; ++i)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            const auto &s = shards_[i].stats;
+            total.hits += s.hits;
+            total.misses += s.misses;
+            total.insertions += s.insertions;
+            total.evictions += s.evictions;
+            total.expirations += s.expirations;
+            total.size += shards_[i].index.size();
+        }
+        return total;
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        TimePoint expiresAt;
+    };
+
+    // Shards sit on their own cache lines so that locking one does not slow down its neighbours.
+    // Counters are kept per shard under the shard lock rather than in shared atomics for the same reason.
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+        std::size_t capacity = 1;
+        Stats stats{};
+    };
+
+    Shard &shardFor(const Key &key)
+    {
+        return shards_[Hash{}(key) % shardCount_];
+    }
+
+    std::size_t shardCount_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+#endif // SHARDED_LRU_CACHE_H
@@ -0,0 +1,406 @@
+//
+// Created by fred on 5/5/24.
+//
+#include <Tracing.h>
+#include <algorithm>
+#include <cerrno>
+#include <config.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+// A batch holds at most this many spans, so a burst is written as several moderately sized lines
+static constexpr std::size_t MaxBatchSpans = 512;
+
+namespace
+{
+std::uint64_t randomId() noexcept
+{
+    thread_local std::mt19937_64 engine{std::random_device{}()};
+    std::uint64_t id;
+    do
+        id = engine();
+    while (id == 0);
+    return id;
+}
+
+template <std::size_t Size>
+bool isZero(const std::array<std::uint8_t, Size> &id)
+{
+    return std::all_of(id.begin(), id.end(), [](std::uint8_t b) { return b == 0; });
+}
+
+/// Decode lowercase hex, as the traceparent format requires
+template <std::size_t Size>
+bool parseHex(std::string_view text, std::array<std::uint8_t, Size> &out)
+{
+    auto digit = [](char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        return -1;
+    };
+
+    if (text.size() != Size * 2)
+        return false;
+    for (std::size_t i = 0; i < Size; ++i)
+    {
+        auto high = digit(text[2 * i]);
+        auto low = digit(text[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        out[i] = static_cast<std::uint8_t>(high * 16 + low);
+    }
+    return true;
+}
+
+template <std::size_t Size>
+void appendHex(std::string &out, const std::array<std::uint8_t, Size> &id)
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    for (auto b : id)
+    {
+        out += digits[b >> 4];
+        out += digits[b & 0xf];
+    }
+}
+
+void appendEscaped(std::string &out, std::string_view text)
+{
+    for (auto c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+        }
+        else
+        {
+            out += c;
+        }
+    }
+}
+} // namespace
+
+std::optional<TraceContext> TraceContext::parse(std::string_view traceparent)
+{
+    // version-traceid-spanid-flags. Later versions may append fields, which are ignored.
+    if (traceparent.size() < 55 || traceparent[2] != '-' || traceparent[35] != '-' || traceparent[52] != '-')
+        return std::nullopt;
+
+    std::array<std::uint8_t, 1> version{};
+    std::array<std::uint8_t, 1> flags{};
+    if (!parseHex(traceparent.substr(0, 2), version) || version[0] == 0xff ||
+        (version[0] == 0 && traceparent.size() != 55) || (traceparent.size() > 55 && traceparent[55] != '-'))
+        return std::nullopt;
+
+    TraceContext context;
+    if (!parseHex(traceparent.substr(3, 32), context.traceId) ||
+        !parseHex(traceparent.substr(36, 16), context.spanId) || !parseHex(traceparent.substr(53, 2), flags) ||
+        isZero(context.traceId) || isZero(context.spanId))
+        return std::nullopt;
+
+    context.sampled = (flags[0] & 0x01) != 0;
+    return context;
+}
+
+std::string TraceContext::traceparent() const
+{
+    std::string header = "00-";
+    header.reserve(55);
+    appendHex(header, traceId);
+    header += '-';
+    appendHex(header, spanId);
+    header += sampled ? "-01" : "-00";
+    return header;
+}
+
+TraceContext TraceContext::current() noexcept
+{
+    const auto *context = TraceScope::innermost;
+    return context != nullptr ? *context : TraceContext{};
+}
+
+Span::Span(std::string_view name, const TraceContext &parent) noexcept
+{
+    if (!parent.sampled)
+        return;
+    parentSpanId = parent.spanId;
+    begin(name, parent.traceId);
+}
+
+Span::Span(Span &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+Span &Span::operator=(Span &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    end();
+    spanContext = other.spanContext;
+    parentSpanId = other.parentSpanId;
+    spanName = other.spanName;
+    startTime = other.startTime;
+    startUnixNano = other.startUnixNano;
+    server = other.server;
+    failed = other.failed;
+    isRecording = other.isRecording;
+    other.spanContext = {};
+    other.isRecording = false;
+    return *this;
+}
+
+void Span::begin(std::string_view name, const std::array<std::uint8_t, 16> &traceId) noexcept
+{
+    auto id = randomId();
+    std::memcpy(spanContext.spanId.data(), &id, sizeof(id));
+    spanContext.traceId = traceId;
+    spanContext.sampled = true;
+    spanName = name;
+    startTime = std::chrono::steady_clock::now();
+    startUnixNano = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    isRecording = true;
+}
+
+void Span::end() noexcept
+{
+    if (!isRecording)
+        return;
+    isRecording = false;
+    Tracer::getInstance().submit(*this, std::chrono::steady_clock::now());
+}
+
+/**
+     * @brief Get the Tracer instance. It is created on first use.
+     *
+     * @return Reference to the tracer instance.
+     */
+Tracer &Tracer::getInstance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+/**
+     * @brief Open the trace file, size the span queue and start the exporter thread.
+     *
+     * @param options Where to write spans and which share of new traces to record.
+     */
+void Tracer::start(const TracingOptions &options)
+{
+    if (enabled())
+        return;
+
+    traceFd = ::open(options.file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (traceFd < 0)
+        throw std::runtime_error(fmt::format("Failed to open trace file {}: {}", options.file, std::strerror(errno)));
+
+    if (options.sampleRatio >= 1.0)
+        sampleThreshold = std::numeric_limits<std::uint64_t>::max();
+    else if (options.sampleRatio <= 0.0)
+        sampleThreshold = 0;
+    else
+        sampleThreshold = static_cast<std::uint64_t>(options.sampleRatio * 18446744073709551616.0);
+
+    flushInterval = std::max(std::chrono::milliseconds(1), options.flushInterval);
+    queue = std::make_unique<MpscRingBuffer<Record>>(options.queueCapacity);
+    running = true;
+    exporter = std::thread(&Tracer::exportSpans, this);
+    active.store(true, std::memory_order_release);
+}
+
+/**
+     * @brief Stop recording new spans, write the ones still queued and join the exporter thread.
+     */
+void Tracer::stop()
+{
+    active.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(exporterMutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    condition.notify_one();
+    if (exporter.joinable())
+        exporter.join();
+    ::close(traceFd);
+    traceFd = -1;
+}
+
+Span Tracer::startRequest(std::string_view name, std::string_view traceparent)
+{
+    Span span;
+    if (!enabled())
+        return span;
+
+    if (auto parent = TraceContext::parse(traceparent))
+    {
+        // The caller made the sampling decision for the whole trace
+        if (parent->sampled)
+        {
+            span.parentSpanId = parent->spanId;
+            span.begin(name, parent->traceId);
+        }
+    }
+    else
+    {
+        std::array<std::uint8_t, 16> traceId;
+        auto high = randomId();
+        auto low = randomId();
+        std::memcpy(traceId.data(), &high, sizeof(high));
+        std::memcpy(traceId.data() + sizeof(high), &low, sizeof(low));
+        // Deciding from the random part of the trace id samples every process of a trace alike
+        if (sampleThreshold == std::numeric_limits<std::uint64_t>::max() || low < sampleThreshold)
+            span.begin(name, traceId);
+    }
+    span.server = true;
+    return span;
+}
+
+Tracer::Stats Tracer::stats() const
+{
+    return {exported.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed)};
+}
+
+/**
+     * @brief Copy a finished span into a queue slot. The span is dropped if the queue is full.
+     */
+void Tracer::submit(const Span &span, std::chrono::steady_clock::time_point end) noexcept
+{
+    if (!enabled())
+        return;
+
+    auto fill = [&span, end](Record &record)
+    {
+        record.traceId = span.spanContext.traceId;
+        record.spanId = span.spanContext.spanId;
+        record.parentSpanId = span.parentSpanId;
+        record.startUnixNano = span.startUnixNano;
+        record.endUnixNano =
+            span.startUnixNano +
+            static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end - span.startTime).count());
+        record.nameSize = static_cast<std::uint8_t>(std::min(span.spanName.size(), sizeof(record.name)));
+        std::memcpy(record.name, span.spanName.data(), record.nameSize);
+        record.server = span.server;
+        record.error = span.failed;
+    };
+    if (!queue->tryPush(fill))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+     * @brief Drain the queue once per flush interval and write the spans as OTLP/JSON export requests.
+     * This function is run in a separate thread until the tracer is stopped and the queue is empty.
+     */
+void Tracer::exportSpans()
+{
+    const auto prefix = fmt::format("{{\"resourceSpans\":[{{\"resource\":{{\"attributes\":[{{\"key\":\"service.name\","
+                                    "\"value\":{{\"stringValue\":\"{0}\"}}}}]}},\"scopeSpans\":[{{\"scope\":"
+                                    "{{\"name\":\"{0}\"}},\"spans\":[",
+                                    project_name);
+    constexpr std::string_view suffix = "]}]}]}\n";
+    std::string batch;
+
+    for (;;)
+    {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(exporterMutex);
+            condition.wait_for(lock, flushInterval, [this] { return !running; });
+            stopping = !running;
+        }
+
+        for (;;)
+        {
+            auto lineStart = batch.size();
+            batch += prefix;
+            auto first = true;
+            auto count = queue->drain(
+                [&](const Record &record)
+                {
+                    if (!first)
+                        batch += ',';
+                    first = false;
+                    batch += "{\"traceId\":\"";
+                    appendHex(batch, record.traceId);
+                    batch += "\",\"spanId\":\"";
+                    appendHex(batch, record.spanId);
+                    if (!isZero(record.parentSpanId))
+                    {
+                        batch += "\",\"parentSpanId\":\"";
+                        appendHex(batch, record.parentSpanId);
+                    }
+                    batch += "\",\"name\":\"";
+                    appendEscaped(batch, std::string_view(record.name, record.nameSize));
+                    // OTLP span kinds: 1 internal, 2 server. Status code 2 is an error.
+                    fmt::format_to(std::back_inserter(batch),
+                                   "\",\"kind\":{},\"startTimeUnixNano\":\"{}\",\"endTimeUnixNano\":\"{}\"",
+                                   record.server ? 2 : 1,
+                                   record.startUnixNano,
+                                   record.endUnixNano);
+                    if (record.error)
+                        batch += ",\"status\":{\"code\":2}";
+                    batch += '}';
+                },
+                MaxBatchSpans);
+
+            if (count == 0)
+            {
+                batch.resize(lineStart);
+                break;
+            }
+            batch += suffix;
+            exported.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        writeBatch(batch);
+        if (stopping)
+            break;
+    }
+}
+
+/**
+     * @brief Append a batch to the trace file and clear it.
+     *
+     * @param batch Newline separated export requests.
+     */
+void Tracer::writeBatch(std::string &batch)
+{
+    std::size_t offset = 0;
+    while (offset < batch.size())
+    {
+        auto n = ::write(traceFd, batch.data() + offset, batch.size() - offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Failed to write trace file: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        offset += static_cast<std::size_t>(n);
+    }
+    batch.clear();
+}
@@ -0,0 +1,269 @@
+/**
+ * @file Tracing.h
+ * @author Frederik Pedersen
+ * @brief Request tracing with W3C trace context propagation and a sampled exporter writing OTLP/JSON.
+ * @version 0.1
+ * @date 2024-05-05
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include "MpscRingBuffer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/// Identifies a span and the trace it belongs to, as carried in a W3C traceparent header
+struct TraceContext
+{
+    std::array<std::uint8_t, 16> traceId{};
+    std::array<std::uint8_t, 8> spanId{};
+    bool sampled = false;
+
+    /**
+     * @brief Parse a version 00 traceparent header, e.g. 00-<32 hex trace id>-<16 hex span id>-01.
+     *
+     * @return The context, or std::nullopt if the header is malformed or has all-zero ids
+     */
+    static std::optional<TraceContext> parse(std::string_view traceparent);
+
+    /// Format as a traceparent header
+    std::string traceparent() const;
+
+    /// The context made current on this thread by the innermost TraceScope, or an unsampled one if there is none
+    static TraceContext current() noexcept;
+};
+
+/**
+ * @brief One timed operation within a trace.
+ *
+ * A span records nothing unless its parent is sampled, so code can be instrumented unconditionally: an unsampled
+ * span costs a branch. A recording span reads the clock when it starts and ends, and hands a fixed-size record to
+ * the exporter's lock-free queue when it ends.
+ */
+class Span
+{
+public:
+    /// A span that records nothing
+    Span() = default;
+
+    /**
+     * @brief Start a child span.
+     *
+     * @param name Must stay valid until the span ends, e.g. a string literal
+     * @param parent The parent span's context, the span only records if it is sampled
+     */
+    Span(std::string_view name, const TraceContext &parent) noexcept;
+
+    Span(Span &&other) noexcept;
+    Span &operator=(Span &&other) noexcept;
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+    ~Span()
+    {
+        end();
+    }
+
+    bool recording() const noexcept
+    {
+        return isRecording;
+    }
+
+    /// The context to start child spans from. Unsampled if this span is not recording.
+    const TraceContext &context() const noexcept
+    {
+        return spanContext;
+    }
+
+    /// Rename the span, e.g. once the route of a request is known. The name must stay valid until the span ends.
+    void setName(std::string_view name) noexcept
+    {
+        spanName = name;
+    }
+
+    /// Mark the operation as failed
+    void setError() noexcept
+    {
+        failed = true;
+    }
+
+    /// Finish the span and hand it to the exporter. Later calls do nothing.
+    void end() noexcept;
+
+private:
+    friend class Tracer;
+
+    void begin(std::string_view name, const std::array<std::uint8_t, 16> &traceId) noexcept;
+
+    TraceContext spanContext;
+    std::array<std::uint8_t, 8> parentSpanId{};
+    std::string_view spanName;
+    std::chrono::steady_clock::time_point startTime;
+    std::uint64_t startUnixNano = 0;
+    bool server = false;
+    bool failed = false;
+    bool isRecording = false;
+};
+
+/**
+ * @brief Make a trace context current on this thread for the lifetime of the scope.
+ *
+ * Scopes nest, so the current contexts of a thread form a stack. Work that continues on another thread, such as
+ * a job on a thread pool or a completion handler, takes TraceContext::current() along and opens its own scope.
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(const TraceContext &context) noexcept : previous(innermost)
+    {
+        innermost = &context;
+    }
+
+    ~TraceScope()
+    {
+        innermost = previous;
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    friend struct TraceContext;
+
+    static inline thread_local const TraceContext *innermost = nullptr;
+    const TraceContext *previous;
+};
+
+/**
+ * @brief A span that is a child of the current context and is itself current until it goes out of scope.
+ */
+class ScopedSpan
+{
+public:
+    /// @param name Must stay valid until the span ends, e.g. a string literal
+    explicit ScopedSpan(std::string_view name) noexcept
+        : child(name, TraceContext::current()), scope(child.context())
+    {
+    }
+
+    Span &span() noexcept
+    {
+        return child;
+    }
+
+private:
+    // Declared first, so the scope is left before the span ends
+    Span child;
+    TraceScope scope;
+};
+
+struct TracingOptions
+{
+    /// File the finished spans are appended to, one OTLP/JSON export request per line
+    std::string file;
+    /// Share of new traces that are recorded. Requests with a traceparent header follow its sampled flag.
+    double sampleRatio = 0.01;
+    /// Finished spans that may wait for the exporter, further spans are dropped
+    std::size_t queueCapacity = 8192;
+    /// Longest time a finished span waits before it is written
+    std::chrono::milliseconds flushInterval{1000};
+};
+
+/**
+ * @brief Starts request traces and exports finished spans.
+ *
+ * Spans are exported by a background thread, which drains the queue into batches and appends each batch to the
+ * trace file as one line in the OTLP/JSON format, the same format an OpenTelemetry collector's file exporter
+ * writes and its file receiver reads. Tracing is off until start() is called.
+ */
+class Tracer
+{
+public:
+    struct Stats
+    {
+        std::uint64_t exported;
+        std::uint64_t dropped;
+    };
+
+    static Tracer &getInstance();
+
+    Tracer() = default;
+    ~Tracer();
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    /**
+     * @brief Open the trace file and start exporting. Call once, before any request is served.
+     *
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    void start(const TracingOptions &options);
+
+    /// Write the spans still queued and stop the exporter
+    void stop();
+
+    bool enabled() const noexcept
+    {
+        return active.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Start the server span of a request. It continues the caller's trace if the request carries a valid
+     * traceparent header, and starts a new trace that is sampled at the configured ratio otherwise.
+     *
+     * @param name Must stay valid until the span ends
+     * @param traceparent The request's traceparent header, empty if it has none
+     */
+    Span startRequest(std::string_view name, std::string_view traceparent);
+
+    Stats stats() const;
+
+private:
+    friend class Span;
+
+    struct Record
+    {
+        std::array<std::uint8_t, 16> traceId;
+        std::array<std::uint8_t, 8> spanId;
+        std::array<std::uint8_t, 8> parentSpanId;
+        std::uint64_t startUnixNano;
+        std::uint64_t endUnixNano;
+        std::uint8_t nameSize;
+        char name[63];
+        bool server;
+        bool error;
+    };
+
+    void submit(const Span &span, std::chrono::steady_clock::time_point end) noexcept;
+    void exportSpans();
+    void writeBatch(std::string &batch);
+
+    std::atomic<bool> active{false};
+    std::uint64_t sampleThreshold = 0;
+    std::chrono::milliseconds flushInterval{1000};
+    std::unique_ptr<MpscRingBuffer<Record>> queue;
+    int traceFd = -1;
+    std::atomic<std::uint64_t> exported{0};
+    std::atomic<std::uint64_t> dropped{0};
+    // Only the exporter waits on this, spans are submitted without taking the lock
+    std::mutex exporterMutex;
+    std::condition_variable condition;
+    bool running = false;
+    std::thread exporter;
+};
+
+#endif // TRACING_H
@@ -0,0 +1,258 @@
+//
+// Created by fred on 5/7/24.
+//
+#include "Utility.h"
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UTILITY_HEX_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+constexpr char HexDigits[] = "0123456789abcdef";
+
+/// The two hex digits of every byte value
+constexpr std::array<std::array<char, 2>, 256> makeEncodeTable()
+{
+    std::array<std::array<char, 2>, 256> table{};
+    for (std::size_t i = 0; i < table.size(); ++i)
+        table[i] = {HexDigits[i >> 4], HexDigits[i & 0xf]};
+    return table;
+}
+
+/// The value of every hex digit of either case, -1 for other characters
+constexpr std::array<int8_t, 256> makeDecodeTable()
+{
+    std::array<int8_t, 256> table{};
+    for (auto &value : table)
+        value = -1;
+    for (int i = 0; i < 10; ++i)
+        table[static_cast<std::size_t>('0' + i)] = static_cast<int8_t>(i);
+    for (int i = 0; i < 6; ++i)
+    {
+        table[static_cast<std::size_t>('a' + i)] = static_cast<int8_t>(10 + i);
+        table[static_cast<std::size_t>('A' + i)] = static_cast<int8_t>(10 + i);
+    }
+    return table;
+}
+
+constexpr auto EncodeTable = makeEncodeTable();
+constexpr auto DecodeTable = makeDecodeTable();
+
+void encodeScalar(const uint8_t *bytes, std::size_t size, char *out) noexcept
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const auto &digits = EncodeTable[bytes[i]];
+        out[2 * i] = digits[0];
+        out[2 * i + 1] = digits[1];
+    }
+}
+
+bool decodeScalar(const char *hex, std::size_t size, uint8_t *out) noexcept
+{
+    // Accumulating the digits with | lets the loop run without a branch per byte, a -1 sets the sign bit
+    int invalid = 0;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        int high = DecodeTable[static_cast<unsigned char>(hex[2 * i])];
+        int low = DecodeTable[static_cast<unsigned char>(hex[2 * i + 1])];
+        invalid |= high | low;
+        out[i] = static_cast<uint8_t>(((high & 0xf) << 4) | (low & 0xf));
+    }
+    return invalid >= 0;
+}
+
+#ifdef UTILITY_HEX_X86
+/**
+ * @brief Look up the hex digits of 16 bytes at once. The nibbles index a 16 byte table with pshufb, and the high
+ * and low digits are interleaved into 32 characters.
+ */
+__attribute__((target("ssse3"))) void encodeSsse3(const uint8_t *bytes, std::size_t size, char *out) noexcept
+{
+    const auto digits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(HexDigits));
+    const auto mask = _mm_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        auto high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(input, 4), mask));
+        auto low = _mm_shuffle_epi8(digits, _mm_and_si128(input, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    encodeScalar(bytes + i, size - i, out + 2 * i);
+}
+
+__attribute__((target("avx2"))) void encodeAvx2(const uint8_t *bytes, std::size_t size, char *out) noexcept
+{
+    const auto digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(HexDigits)));
+    const auto mask = _mm256_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i));
+        auto high = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(input, 4), mask));
+        auto low = _mm256_shuffle_epi8(digits, _mm256_and_si256(input, mask));
+        // Unpacking works within each 128 bit lane, so the halves are put back in order afterwards
+        auto first = _mm256_unpacklo_epi8(high, low);
+        auto second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    // Leaving AVX state dirty would make the SSE code of the tail pay for a state transition on every instruction
+    _mm256_zeroupper();
+    encodeSsse3(bytes + i, size - i, out + 2 * i);
+}
+
+/// Convert 16 characters to their nibble values, clearing valid's bits for characters that are not hex digits
+__attribute__((target("ssse3"))) inline __m128i nibblesSsse3(__m128i chars, int &valid) noexcept
+{
+    // Bytes from 0x80 are negative in the signed comparisons, so they fail both ranges
+    auto isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                 _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    auto lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    auto isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    valid &= _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter));
+
+    auto digitValue = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    auto letterValue = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+    return _mm_or_si128(_mm_and_si128(isDigit, digitValue), _mm_andnot_si128(isDigit, letterValue));
+}
+
+/**
+ * @brief Decode 32 characters into 16 bytes at once. pmaddubsw multiplies each high nibble by 16 and adds the low
+ * one, and packuswb narrows the 16 bit sums back to bytes.
+ */
+__attribute__((target("ssse3"))) bool decodeSsse3(const char *hex, std::size_t size, uint8_t *out) noexcept
+{
+    const auto weights = _mm_set1_epi16(0x0110);
+    int valid = 0xffff;
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        auto first = nibblesSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i)), valid);
+        auto second = nibblesSsse3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i + 16)), valid);
+        auto bytes = _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bytes);
+    }
+    return decodeScalar(hex + 2 * i, size - i, out + i) && valid == 0xffff;
+}
+
+__attribute__((target("avx2"))) inline __m256i nibblesAvx2(__m256i chars, __m256i &valid) noexcept
+{
+    auto isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    auto lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    auto isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isLetter));
+
+    auto digitValue = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    auto letterValue = _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10));
+    return _mm256_or_si256(_mm256_and_si256(isDigit, digitValue), _mm256_andnot_si256(isDigit, letterValue));
+}
+
+__attribute__((target("avx2"))) bool decodeAvx2(const char *hex, std::size_t size, uint8_t *out) noexcept
+{
+    const auto weights = _mm256_set1_epi16(0x0110);
+    auto valid = _mm256_set1_epi8(-1);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        auto first = nibblesAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(hex + 2 * i)), valid);
+        auto second = nibblesAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(hex + 2 * i + 32)), valid);
+        auto packed = _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights), _mm256_maddubs_epi16(second, weights));
+        // Packing works within each 128 bit lane, so the four quarters are put back in order afterwards
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    auto allValid = _mm256_movemask_epi8(valid) == -1;
+    _mm256_zeroupper();
+    return decodeSsse3(hex + 2 * i, size - i, out + i) && allValid;
+}
+#endif
+
+struct HexKernels
+{
+    void (*encode)(const uint8_t *, std::size_t, char *) noexcept;
+    bool (*decode)(const char *, std::size_t, uint8_t *) noexcept;
+};
+
+bool supported(Utility::HexKernel kernel) noexcept
+{
+#ifdef UTILITY_HEX_X86
+    __builtin_cpu_init();
+    switch (kernel)
+    {
+    case Utility::HexKernel::Scalar:
+        return true;
+    case Utility::HexKernel::Ssse3:
+        return __builtin_cpu_supports("ssse3");
+    case Utility::HexKernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    }
+    return false;
+#else
+    return kernel == Utility::HexKernel::Scalar;
+#endif
+}
+
+HexKernels kernelsFor(Utility::HexKernel kernel) noexcept
+{
+#ifdef UTILITY_HEX_X86
+    if (kernel == Utility::HexKernel::Avx2)
+        return {encodeAvx2, decodeAvx2};
+    if (kernel == Utility::HexKernel::Ssse3)
+        return {encodeSsse3, decodeSsse3};
+#else
+    (void)kernel;
+#endif
+    return {encodeScalar, decodeScalar};
+}
+
+/// Pick the widest implementation the CPU supports, once
+const HexKernels &hexKernels() noexcept
+{
+    static const HexKernels kernels = []
+    {
+        for (auto kernel : {Utility::HexKernel::Avx2, Utility::HexKernel::Ssse3})
+            if (supported(kernel))
+                return kernelsFor(kernel);
+        return kernelsFor(Utility::HexKernel::Scalar);
+    }();
+    return kernels;
+}
+} // namespace
+
+void Utility::encodeHex(const uint8_t *bytes, std::size_t size, char *out) noexcept
+{
+    hexKernels().encode(bytes, size, out);
+}
+
+bool Utility::decodeHex(std::string_view hex, uint8_t *out) noexcept
+{
+    if (hex.size() % 2 != 0)
+        return false;
+    return hexKernels().decode(hex.data(), hex.size() / 2, out);
+}
+
+bool Utility::hexKernelSupported(HexKernel kernel) noexcept
+{
+    return supported(kernel);
+}
+
+void Utility::encodeHex(HexKernel kernel, const uint8_t *bytes, std::size_t size, char *out) noexcept
+{
+    kernelsFor(kernel).encode(bytes, size, out);
+}
+
+bool Utility::decodeHex(HexKernel kernel, std::string_view hex, uint8_t *out) noexcept
+{
+    if (hex.size() % 2 != 0)
+        return false;
+    return kernelsFor(kernel).decode(hex.data(), hex.size() / 2, out);
+}
@@ -14,17 +14,62 @@
 
 #pragma once
 
-#include <iomanip>
-#include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Utility
 {
 public:
+    /// Implementations of the hex codec, from the portable one to the widest
+    enum class HexKernel
+    {
+        Scalar,
+        Ssse3,
+        Avx2
+    };
+
     Utility();
     ~Utility();
 
+    /**
+     * Write the bytes as lowercase hex, two characters per byte. Uses SSSE3 or AVX2 when the CPU has them.
+     * @param bytes Bytes to encode
+     * @param size Number of bytes
+     * @param out Buffer for 2 * size characters, no terminator is written
+     */
+    static void encodeHex(const uint8_t *bytes, std::size_t size, char *out) noexcept;
+
+    /**
+     * Decode hex digits of either case. Uses SSSE3 or AVX2 when the CPU has them.
+     * @param hex An even number of hex digits
+     * @param out Buffer for hex.size() / 2 bytes
+     * @return false if the length is odd or a character is not a hex digit, out is then unspecified
+     */
+    static bool decodeHex(std::string_view hex, uint8_t *out) noexcept;
+
+    /**
+     * Whether the CPU can run a hex kernel, the scalar one is always available
+     * @param kernel The kernel to check
+     * @return bool
+     */
+    static bool hexKernelSupported(HexKernel kernel) noexcept;
+
+    /**
+     * encodeHex() with a given kernel instead of the widest available, for tests and benchmarks
+     * @param kernel A kernel for which hexKernelSupported() is true
+     */
+    static void encodeHex(HexKernel kernel, const uint8_t *bytes, std::size_t size, char *out) noexcept;
+
+    /**
+     * decodeHex() with a given kernel instead of the widest available, for tests and benchmarks
+     * @param kernel A kernel for which hexKernelSupported() is true
+     */
+    static bool decodeHex(HexKernel kernel, std::string_view hex, uint8_t *out) noexcept;
+
     /**
      * Convert a vector of bytes to a hex string
      * @param bytes std::vector<uint8_t>
@@ -32,29 +77,22 @@ public:
      */
     static std::string toHexString(const std::vector<uint8_t> &bytes)
     {
-        std::stringstream hexStream;
-        hexStream << std::hex << std::setfill('0');
-        for (auto byte : bytes)
-        {
-            hexStream << std::setw(2) << static_cast<int>(byte);
-        }
-        return hexStream.str();
+        std::string hex(bytes.size() * 2, '\0');
+        encodeHex(bytes.data(), bytes.size(), hex.data());
+        return hex;
     }
 
     /**
      * Convert a hex string to a vector of bytes
      * @param hex std::string
      * @return std::vector<uint8_t>
+     * @throws std::invalid_argument if hex is not an even number of hex digits
      */
     static std::vector<uint8_t> fromHexString(const std::string &hex)
     {
-        std::vector<uint8_t> bytes;
-        for (size_t i = 0; i < hex.length(); i += 2)
-        {
-            std::string byteString = hex.substr(i, 2);
-            uint8_t byte = static_cast<uint8_t>(std::stoi(byteString, nullptr, 16));
-            bytes.push_back(byte);
-        }
+        std::vector<uint8_t> bytes(hex.size() / 2);
+        if (!decodeHex(hex, bytes.data()))
+            throw std::invalid_argument("Invalid hex string");
         return bytes;
     }
 
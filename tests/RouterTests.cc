@@ -0,0 +1,202 @@
+//
+// Created by fred on 5/8/24.
+//
+
+#include <Router.h>
+#include <catch2/catch.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace
+{
+void addRoute(Router &router, std::string_view method, std::string_view path)
+{
+    router.addRoute(method, path, [](const HttpRequest &, HttpResponse &, const RequestContext &) {});
+}
+
+/// The pattern of the route a GET request for target matches, or an empty string if none does
+std::string matchedPattern(const Router &router, std::string_view target, RequestContext &ctx)
+{
+    auto route = router.match(http::verb::get, target, ctx);
+    if (route == nullptr)
+        return {};
+
+    // Route names are "<method> <pattern>"
+    auto name = route->metrics.name();
+    return std::string(name.substr(name.find(' ') + 1));
+}
+
+std::string matchedPattern(const Router &router, std::string_view target)
+{
+    RequestContext ctx;
+    return matchedPattern(router, target, ctx);
+}
+} // namespace
+
+TEST_CASE("Static segments take precedence over parameters and parameters over wildcards", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/users/{*rest}");
+    addRoute(router, "GET", "/users/{name}");
+    addRoute(router, "GET", "/users/me");
+    router.freeze();
+
+    CHECK(matchedPattern(router, "/users/me") == "/users/me");
+    CHECK(matchedPattern(router, "/users/alice") == "/users/{name}");
+    CHECK(matchedPattern(router, "/users/alice/posts") == "/users/{*rest}");
+
+    RequestContext ctx;
+    REQUIRE(matchedPattern(router, "/users/alice/posts/1", ctx) == "/users/{*rest}");
+    CHECK(ctx.param("rest") == "alice/posts/1");
+}
+
+TEST_CASE("A failed static match backtracks into the parameter branch", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/users/me/settings");
+    addRoute(router, "GET", "/users/{id}/posts");
+    router.freeze();
+
+    CHECK(matchedPattern(router, "/users/me/settings") == "/users/me/settings");
+
+    RequestContext ctx;
+    REQUIRE(matchedPattern(router, "/users/me/posts", ctx) == "/users/{id}/posts");
+    CHECK(ctx.paramCount() == 1);
+    CHECK(ctx.param("id") == "me");
+}
+
+TEST_CASE("A failed parameter match drops its captured value", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/files/{name}/raw");
+    addRoute(router, "GET", "/files/{*path}");
+    router.freeze();
+
+    RequestContext ctx;
+    REQUIRE(matchedPattern(router, "/files/a/b", ctx) == "/files/{*path}");
+    CHECK(ctx.paramCount() == 1);
+    CHECK_FALSE(ctx.param("name"));
+    CHECK(ctx.param("path") == "a/b");
+}
+
+TEST_CASE("Integer parameters only match decimal segments", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/items/{id:int}");
+    router.freeze();
+
+    RequestContext ctx;
+    REQUIRE(matchedPattern(router, "/items/42", ctx) == "/items/{id:int}");
+    CHECK(ctx.intParam("id") == 42);
+    REQUIRE(matchedPattern(router, "/items/-7", ctx) == "/items/{id:int}");
+    CHECK(ctx.intParam("id") == -7);
+    REQUIRE(matchedPattern(router, "/items/+7", ctx) == "/items/{id:int}");
+    CHECK(ctx.intParam("id") == 7);
+
+    CHECK(matchedPattern(router, "/items/abc").empty());
+    CHECK(matchedPattern(router, "/items/4x").empty());
+    CHECK(matchedPattern(router, "/items/-").empty());
+    CHECK(matchedPattern(router, "/items/").empty());
+}
+
+TEST_CASE("Integer parameters fall back to string parameters", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/items/{slug}");
+    addRoute(router, "GET", "/items/{id:int}");
+    router.freeze();
+
+    CHECK(matchedPattern(router, "/items/12") == "/items/{id:int}");
+    CHECK(matchedPattern(router, "/items/twelve") == "/items/{slug}");
+}
+
+TEST_CASE("The query string is stripped before matching", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/search/{term}");
+    router.freeze();
+
+    RequestContext ctx;
+    REQUIRE(matchedPattern(router, "/search/cats?page=2&sort=new", ctx) == "/search/{term}");
+    CHECK(ctx.path() == "/search/cats");
+    CHECK(ctx.query() == "page=2&sort=new");
+    CHECK(ctx.param("term") == "cats");
+
+    REQUIRE(matchedPattern(router, "/search/dogs", ctx) == "/search/{term}");
+    CHECK(ctx.query().empty());
+
+    CHECK(matchedPattern(router, "/search?term=cats").empty());
+}
+
+TEST_CASE("Routes only match their own method", "[router]")
+{
+    Router router;
+    addRoute(router, "POST", "/user/login");
+    router.freeze();
+
+    RequestContext ctx;
+    CHECK(router.match(http::verb::post, "/user/login", ctx) != nullptr);
+    CHECK(router.match(http::verb::get, "/user/login", ctx) == nullptr);
+}
+
+TEST_CASE("Conflicting and malformed routes are rejected", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/users/{id}");
+    addRoute(router, "GET", "/files/{*path}");
+
+    CHECK_THROWS_AS(addRoute(router, "GET", "/users/{name}/posts"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/files/{*rest}"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/files/{*path}/raw"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/items/{id:uuid}"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/items/{}"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/items/{id"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/items/x{id}"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/items/{id}x"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "items"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "FETCH", "/items"), std::invalid_argument);
+    CHECK_THROWS_AS(addRoute(router, "GET", "/{a}/{b}/{c}/{d}/{e}/{f}/{g}/{h}/{i}"), std::invalid_argument);
+
+    // A parameter of another type may use another name
+    CHECK_NOTHROW(addRoute(router, "GET", "/users/{number:int}/posts"));
+}
+
+TEST_CASE("Routes cannot be added to a frozen router", "[router]")
+{
+    Router router;
+    addRoute(router, "GET", "/health");
+    router.freeze();
+
+    CHECK(router.isFrozen());
+    CHECK_THROWS_AS(addRoute(router, "GET", "/other"), std::logic_error);
+    CHECK(matchedPattern(router, "/health") == "/health");
+    CHECK(matchedPattern(router, "/other").empty());
+}
+
+TEST_CASE("Body limits can be replaced until the router is frozen", "[router]")
+{
+    Router router;
+    router.addRoute("POST",
+                    "/upload/{name}",
+                    [](const HttpRequest &, HttpResponse &, const RequestContext &) {},
+                    RouteOptions{1024});
+    addRoute(router, "POST", "/login");
+
+    router.setBodyLimit("POST", "/upload/{name}", 4096);
+    router.setBodyLimit("POST", "/login", 256);
+    CHECK_THROWS_AS(router.setBodyLimit("GET", "/login", 256), std::invalid_argument);
+    CHECK_THROWS_AS(router.setBodyLimit("POST", "/upload/file", 256), std::invalid_argument);
+    CHECK_THROWS_AS(router.setBodyLimit("FETCH", "/login", 256), std::invalid_argument);
+
+    router.freeze();
+    CHECK_THROWS_AS(router.setBodyLimit("POST", "/login", 512), std::logic_error);
+
+    RequestContext ctx;
+    auto upload = router.match(http::verb::post, "/upload/a.txt", ctx);
+    REQUIRE(upload != nullptr);
+    CHECK(upload->options.bodyLimit == 4096);
+    auto login = router.match(http::verb::post, "/login", ctx);
+    REQUIRE(login != nullptr);
+    CHECK(login->options.bodyLimit == 256);
+}
@@ -0,0 +1,310 @@
+//
+// Created by fred on 5/8/24.
+//
+
+#include <StaticFiles.h>
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/// A document root in a temporary directory, with a file next to it that must never be served
+class DocumentRoot
+{
+public:
+    DocumentRoot()
+    {
+        std::string pattern = (std::filesystem::temp_directory_path() / "ccfolio-static-XXXXXX").string();
+        if (::mkdtemp(pattern.data()) == nullptr)
+            throw std::runtime_error("Failed to create a temporary directory");
+        base = pattern;
+        std::filesystem::create_directory(base / "www");
+        std::filesystem::create_directory(base / "www" / "docs");
+
+        write("secret.txt", "outside the document root");
+        write("www/index.html", "<h1>home</h1>");
+        write("www/digits.txt", "0123456789");
+        write("www/docs/index.html", "<h1>docs</h1>");
+        write("www/large.bin", std::string(4096, 'x'));
+    }
+
+    ~DocumentRoot()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(base, ec);
+    }
+
+    std::string path() const
+    {
+        return (base / "www").string();
+    }
+
+private:
+    void write(const std::string &name, const std::string &contents)
+    {
+        std::ofstream(base / name, std::ios::binary) << contents;
+    }
+
+    std::filesystem::path base;
+};
+
+/// A request and its response in an arena, the way HttpSession allocates them
+struct Exchange
+{
+    explicit Exchange(std::string_view target, std::vector<std::pair<http::field, std::string>> fields = {})
+        : req(std::piecewise_construct, std::make_tuple(), std::make_tuple(RequestAllocator(arena))),
+          res(std::piecewise_construct,
+              std::make_tuple(RequestAllocator(arena)),
+              std::make_tuple(RequestAllocator(arena)))
+    {
+        req.method(http::verb::get);
+        req.target(boost::beast::string_view(target.data(), target.size()));
+        for (auto const &[field, value] : fields)
+            req.set(field, value);
+    }
+
+    bool serve(const StaticFiles &files)
+    {
+        return files.serve(req, res, body);
+    }
+
+    std::string header(http::field field) const
+    {
+        auto it = res.find(field);
+        return it == res.end() ? std::string() : std::string(it->value());
+    }
+
+    MonotonicArena arena;
+    HttpRequest req;
+    HttpResponse res;
+    StaticFiles::Body body;
+};
+
+StaticFileOptions smallFiles()
+{
+    StaticFileOptions options;
+    options.smallFileBytes = 1024;
+    return options;
+}
+} // namespace
+
+TEST_CASE("Static files are served below the document root", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    Exchange file("/digits.txt");
+    REQUIRE(file.serve(files));
+    CHECK(file.res.result() == http::status::ok);
+    CHECK(file.res.body() == "0123456789");
+    CHECK(file.header(http::field::content_type) == "text/plain; charset=utf-8");
+    CHECK(file.header(http::field::accept_ranges) == "bytes");
+
+    Exchange directory("/docs/");
+    REQUIRE(directory.serve(files));
+    CHECK(directory.res.body() == "<h1>docs</h1>");
+
+    Exchange query("/index.html?v=3#top");
+    REQUIRE(query.serve(files));
+    CHECK(query.res.body() == "<h1>home</h1>");
+
+    Exchange encoded("/%64igits.txt");
+    REQUIRE(encoded.serve(files));
+    CHECK(encoded.res.body() == "0123456789");
+
+    Exchange missing("/missing.txt");
+    CHECK_FALSE(missing.serve(files));
+    Exchange notAFile("/docs");
+    CHECK_FALSE(notAFile.serve(files));
+}
+
+TEST_CASE("Targets that could leave the document root are rejected", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    auto target = GENERATE(as<std::string>{},
+                           "/../secret.txt",
+                           "/docs/../../secret.txt",
+                           "/%2e%2e/secret.txt",
+                           "/%2E%2E/secret.txt",
+                           "/.%2e/secret.txt",
+                           "/docs/..",
+                           "/..",
+                           "/%2e%2e%2fsecret.txt",
+                           "/..\\secret.txt",
+                           "/%5c../secret.txt",
+                           "/digits.txt%00.html",
+                           "/%00",
+                           "/%zz",
+                           "/%2",
+                           "/%",
+                           "digits.txt",
+                           "");
+    INFO("target: " << target);
+
+    Exchange exchange(target);
+    CHECK_FALSE(exchange.serve(files));
+    CHECK(exchange.res.body().empty());
+}
+
+TEST_CASE("Single byte ranges are served as partial content", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    auto range = [&files](std::string value)
+    {
+        auto exchange = std::make_unique<Exchange>("/digits.txt",
+                                                   std::vector<std::pair<http::field, std::string>>{
+                                                       {http::field::range, std::move(value)}});
+        REQUIRE(exchange->serve(files));
+        return exchange;
+    };
+
+    auto bounded = range("bytes=2-4");
+    CHECK(bounded->res.result() == http::status::partial_content);
+    CHECK(bounded->header(http::field::content_range) == "bytes 2-4/10");
+    CHECK(bounded->res.body() == "234");
+
+    auto open = range("bytes=5-");
+    CHECK(open->res.result() == http::status::partial_content);
+    CHECK(open->header(http::field::content_range) == "bytes 5-9/10");
+    CHECK(open->res.body() == "56789");
+
+    auto clamped = range("bytes=8-100");
+    CHECK(clamped->header(http::field::content_range) == "bytes 8-9/10");
+    CHECK(clamped->res.body() == "89");
+
+    auto suffix = range("bytes=-3");
+    CHECK(suffix->header(http::field::content_range) == "bytes 7-9/10");
+    CHECK(suffix->res.body() == "789");
+
+    auto longSuffix = range("bytes=-50");
+    CHECK(longSuffix->header(http::field::content_range) == "bytes 0-9/10");
+    CHECK(longSuffix->res.body() == "0123456789");
+}
+
+TEST_CASE("Unsatisfiable ranges are answered with 416", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    auto value = GENERATE(as<std::string>{}, "bytes=-0", "bytes=10-", "bytes=15-", "bytes=10-20");
+    INFO("range: " << value);
+
+    Exchange exchange("/digits.txt", {{http::field::range, value}});
+    REQUIRE(exchange.serve(files));
+    CHECK(exchange.res.result() == http::status::range_not_satisfiable);
+    CHECK(exchange.header(http::field::content_range) == "bytes */10");
+    CHECK(exchange.res.body().empty());
+}
+
+TEST_CASE("Ranges that are not a single valid byte range get the whole file", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    auto value = GENERATE(as<std::string>{},
+                          "bytes=0-1,4-5",
+                          "bytes=0-1, 4-5",
+                          "bytes=5-2",
+                          "bytes=abc",
+                          "bytes=-",
+                          "bytes=1-x",
+                          "items=0-1");
+    INFO("range: " << value);
+
+    Exchange exchange("/digits.txt", {{http::field::range, value}});
+    REQUIRE(exchange.serve(files));
+    CHECK(exchange.res.result() == http::status::ok);
+    CHECK(exchange.header(http::field::content_range).empty());
+    CHECK(exchange.res.body() == "0123456789");
+}
+
+TEST_CASE("If-None-Match answers 304 for a matching tag", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    Exchange first("/digits.txt");
+    REQUIRE(first.serve(files));
+    auto etag = first.header(http::field::etag);
+    REQUIRE_FALSE(etag.empty());
+
+    for (auto const &matching :
+         std::vector<std::string>{etag, "W/" + etag, "\"other\", " + etag, " \"a\" , W/" + etag + " ", "*"})
+    {
+        INFO("If-None-Match: " << matching);
+        Exchange cached("/digits.txt", {{http::field::if_none_match, matching}});
+        REQUIRE(cached.serve(files));
+        CHECK(cached.res.result() == http::status::not_modified);
+        CHECK(cached.res.body().empty());
+    }
+
+    Exchange changed("/digits.txt", {{http::field::if_none_match, "\"other\", W/\"stale\""}});
+    REQUIRE(changed.serve(files));
+    CHECK(changed.res.result() == http::status::ok);
+    CHECK(changed.res.body() == "0123456789");
+}
+
+TEST_CASE("If-Range only allows the range for the current tag", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    Exchange first("/digits.txt");
+    REQUIRE(first.serve(files));
+    auto etag = first.header(http::field::etag);
+
+    Exchange current("/digits.txt", {{http::field::range, "bytes=0-1"}, {http::field::if_range, etag}});
+    REQUIRE(current.serve(files));
+    CHECK(current.res.result() == http::status::partial_content);
+    CHECK(current.res.body() == "01");
+
+    Exchange stale("/digits.txt", {{http::field::range, "bytes=0-1"}, {http::field::if_range, "\"stale\""}});
+    REQUIRE(stale.serve(files));
+    CHECK(stale.res.result() == http::status::ok);
+    CHECK(stale.header(http::field::content_range).empty());
+    CHECK(stale.res.body() == "0123456789");
+
+    // If-Range needs a strong match
+    Exchange weak("/digits.txt", {{http::field::range, "bytes=0-1"}, {http::field::if_range, "W/" + etag}});
+    REQUIRE(weak.serve(files));
+    CHECK(weak.res.result() == http::status::ok);
+}
+
+TEST_CASE("Large files are left for the session to send from the descriptor", "[static]")
+{
+    DocumentRoot root;
+    StaticFiles files(root.path(), smallFiles());
+
+    Exchange whole("/large.bin");
+    REQUIRE(whole.serve(files));
+    CHECK(whole.res.body().empty());
+    REQUIRE(whole.body.file);
+    CHECK_FALSE(whole.body.file->inMemory());
+    CHECK(whole.body.offset == 0);
+    CHECK(whole.body.length == 4096);
+
+    Exchange range("/large.bin", {{http::field::range, "bytes=1000-1999"}});
+    REQUIRE(range.serve(files));
+    CHECK(range.res.result() == http::status::partial_content);
+    CHECK(range.body.offset == 1000);
+    CHECK(range.body.length == 1000);
+
+    Exchange head("/large.bin");
+    head.req.method(http::verb::head);
+    REQUIRE(head.serve(files));
+    CHECK_FALSE(head.body.file);
+    CHECK(head.header(http::field::content_length) == "4096");
+}
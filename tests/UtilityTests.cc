@@ -0,0 +1,169 @@
+//
+// Created by fred on 5/8/24.
+//
+
+#include <Utility.h>
+#include <catch2/catch.hpp>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+/// Straightforward encoding to check the kernels against
+std::string referenceHex(const std::vector<uint8_t> &bytes)
+{
+    constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (auto byte : bytes)
+    {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0xf];
+    }
+    return hex;
+}
+
+bool isHexDigit(int c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+std::string kernelName(Utility::HexKernel kernel)
+{
+    switch (kernel)
+    {
+    case Utility::HexKernel::Scalar:
+        return "scalar";
+    case Utility::HexKernel::Ssse3:
+        return "SSSE3";
+    case Utility::HexKernel::Avx2:
+        return "AVX2";
+    }
+    return "unknown";
+}
+
+/// Every kernel in turn, ending the test case early for kernels the CPU cannot run
+Utility::HexKernel generateKernel()
+{
+    auto kernel = GENERATE(Utility::HexKernel::Scalar, Utility::HexKernel::Ssse3, Utility::HexKernel::Avx2);
+    if (!Utility::hexKernelSupported(kernel))
+        WARN("Skipping the " << kernelName(kernel) << " kernel, which this CPU does not support");
+    return kernel;
+}
+} // namespace
+
+// Lengths around the 16 and 32 byte blocks of the SIMD kernels and their scalar tails
+static const std::vector<std::size_t> HexLengths = {0, 1, 2, 7, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 100, 257};
+
+TEST_CASE("Hex kernels round-trip every length", "[utility][hex]")
+{
+    auto kernel = generateKernel();
+    if (!Utility::hexKernelSupported(kernel))
+        return;
+    INFO("kernel: " << kernelName(kernel));
+
+    std::mt19937 random(42);
+    for (auto size : HexLengths)
+    {
+        INFO("bytes: " << size);
+        std::vector<uint8_t> bytes(size);
+        for (auto &byte : bytes)
+            byte = static_cast<uint8_t>(random());
+
+        std::string hex(2 * size, '\0');
+        Utility::encodeHex(kernel, bytes.data(), bytes.size(), hex.data());
+        CHECK(hex == referenceHex(bytes));
+
+        std::vector<uint8_t> decoded(size);
+        REQUIRE(Utility::decodeHex(kernel, hex, decoded.data()));
+        CHECK(decoded == bytes);
+    }
+}
+
+TEST_CASE("Hex kernels encode every byte value", "[utility][hex]")
+{
+    auto kernel = generateKernel();
+    if (!Utility::hexKernelSupported(kernel))
+        return;
+    INFO("kernel: " << kernelName(kernel));
+
+    std::vector<uint8_t> bytes(256);
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = static_cast<uint8_t>(i);
+
+    std::string hex(2 * bytes.size(), '\0');
+    Utility::encodeHex(kernel, bytes.data(), bytes.size(), hex.data());
+    CHECK(hex == referenceHex(bytes));
+}
+
+TEST_CASE("Hex kernels decode digits of either case", "[utility][hex]")
+{
+    auto kernel = generateKernel();
+    if (!Utility::hexKernelSupported(kernel))
+        return;
+    INFO("kernel: " << kernelName(kernel));
+
+    std::string hex = "0123456789abcdefABCDEF0aFfEe9D8c7B6a5F4e3D2c1B0a00fFfF0000A0a0B1b2";
+    std::vector<uint8_t> expected = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0xab, 0xcd, 0xef,
+                                     0x0a, 0xff, 0xee, 0x9d, 0x8c, 0x7b, 0x6a, 0x5f, 0x4e, 0x3d, 0x2c,
+                                     0x1b, 0x0a, 0x00, 0xff, 0xff, 0x00, 0x00, 0xa0, 0xa0, 0xb1, 0xb2};
+    REQUIRE(hex.size() == 2 * expected.size());
+
+    std::vector<uint8_t> decoded(expected.size());
+    REQUIRE(Utility::decodeHex(kernel, hex, decoded.data()));
+    CHECK(decoded == expected);
+}
+
+TEST_CASE("Hex kernels reject odd lengths", "[utility][hex]")
+{
+    auto kernel = generateKernel();
+    if (!Utility::hexKernelSupported(kernel))
+        return;
+    INFO("kernel: " << kernelName(kernel));
+
+    std::vector<uint8_t> decoded(64);
+    for (auto size : {1, 3, 31, 33, 63, 65, 127})
+    {
+        INFO("digits: " << size);
+        CHECK_FALSE(Utility::decodeHex(kernel, std::string(static_cast<std::size_t>(size), 'a'), decoded.data()));
+    }
+}
+
+TEST_CASE("Hex kernels reject every byte that is not a hex digit", "[utility][hex]")
+{
+    auto kernel = generateKernel();
+    if (!Utility::hexKernelSupported(kernel))
+        return;
+    INFO("kernel: " << kernelName(kernel));
+
+    // 160 digits reach the 64 digit AVX2 loop, the 32 digit SSSE3 loop and the scalar tail
+    const std::string valid(160, 'c');
+    const std::vector<std::size_t> positions = {0, 1, 15, 16, 31, 32, 33, 63, 64, 95, 127, 128, 129, 158, 159};
+    std::vector<uint8_t> decoded(valid.size() / 2);
+    REQUIRE(Utility::decodeHex(kernel, valid, decoded.data()));
+
+    for (int c = 0; c < 256; ++c)
+    {
+        if (isHexDigit(c))
+            continue;
+        for (auto position : positions)
+        {
+            auto hex = valid;
+            hex[position] = static_cast<char>(c);
+            if (Utility::decodeHex(kernel, hex, decoded.data()))
+                FAIL_CHECK("accepted byte " << c << " at position " << position);
+        }
+    }
+}
+
+TEST_CASE("Hex strings convert to bytes and back", "[utility][hex]")
+{
+    std::vector<uint8_t> bytes = {0x00, 0x7f, 0x80, 0xff, 0x12};
+    CHECK(Utility::toHexString(bytes) == "007f80ff12");
+    CHECK(Utility::fromHexString("007F80fF12") == bytes);
+    CHECK(Utility::fromHexString("").empty());
+    CHECK_THROWS_AS(Utility::fromHexString("abc"), std::invalid_argument);
+    CHECK_THROWS_AS(Utility::fromHexString("zz"), std::invalid_argument);
+}
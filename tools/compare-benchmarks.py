@@ -0,0 +1,102 @@
+#!/usr/bin/env python
+"""Compare two Google Benchmark JSON reports, e.g. the benchmarks.json written
+by the run_benchmarks target on a baseline and on a change.
+
+Benchmarks are matched by name. When the reports were produced with
+repetitions, the mean aggregates are compared, otherwise the single runs.
+The exit code is 1 if any benchmark got slower by more than the threshold.
+
+Usage:
+    compare-benchmarks.py baseline.json current.json [--threshold 10]
+
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Map benchmark name to its entry, preferring mean aggregates."""
+    with open(path) as f:
+        report = json.load(f)
+
+    runs = {}
+    means = {}
+    for entry in report.get("benchmarks", []):
+        if entry.get("error_occurred"):
+            continue
+        if entry.get("run_type") == "aggregate":
+            if entry.get("aggregate_name") == "mean":
+                means[entry["run_name"]] = entry
+        else:
+            runs.setdefault(entry.get("run_name", entry["name"]), entry)
+    runs.update(means)
+    return runs
+
+
+def change(baseline, current):
+    if baseline == 0:
+        return 0.0
+    return (current - baseline) / baseline * 100.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="report of the baseline run")
+    parser.add_argument("current", help="report of the run to check")
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=10.0,
+        help="largest allowed slowdown in percent (default: %(default)s)")
+    parser.add_argument(
+        "--metric",
+        choices=["real_time", "cpu_time"],
+        default="real_time",
+        help="time that is checked against the threshold (default: %(default)s)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    names = [name for name in current if name in baseline]
+    if not names:
+        print("No benchmarks in common", file=sys.stderr)
+        return 2
+
+    width = max(len(name) for name in names)
+    print("{:<{}}  {:>14}  {:>14}  {:>8}  {:>8}".format(
+        "Benchmark", width, "Baseline", "Current", "Time", "CPU"))
+
+    regressions = []
+    for name in names:
+        old = baseline[name]
+        new = current[name]
+        real = change(old["real_time"], new["real_time"])
+        cpu = change(old["cpu_time"], new["cpu_time"])
+        checked = real if args.metric == "real_time" else cpu
+        marker = ""
+        if checked > args.threshold:
+            regressions.append(name)
+            marker = "  REGRESSION"
+        print("{:<{}}  {:>11.1f} {:<2}  {:>11.1f} {:<2}  {:>+7.1f}%  {:>+7.1f}%{}".format(
+            name, width, old["real_time"], old.get("time_unit", "ns"),
+            new["real_time"], new.get("time_unit", "ns"), real, cpu, marker))
+
+    for name in sorted(set(baseline) - set(current)):
+        print("{}: missing from current report".format(name))
+    for name in sorted(set(current) - set(baseline)):
+        print("{}: new, no baseline".format(name))
+
+    if regressions:
+        print("\n{} benchmark(s) slower by more than {}%".format(
+            len(regressions), args.threshold), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())